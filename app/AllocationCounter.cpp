@@ -0,0 +1,86 @@
+#include "AllocationCounter.h"
+
+#ifdef HOMESCREEN_ALLOC_CHECK
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+static thread_local uint64_t allocations = 0;
+
+uint64_t thread_allocation_count()
+{
+    return allocations;
+}
+
+AllocationCheck::AllocationCheck(const char *what, bool enabled)
+{
+    this->what = what;
+    this->enabled = enabled;
+    this->start = allocations;
+}
+
+AllocationCheck::~AllocationCheck()
+{
+    uint64_t count = allocations - this->start;
+    if (this->enabled && count != 0) {
+        fprintf(stderr, "allocation check: %s performed %llu heap allocations\n",
+                this->what, (unsigned long long) count);
+        abort();
+    }
+}
+
+/*
+ * glibc's own entry points; defining malloc and friends here interposes
+ * them for every library in the process, operator new included.
+ */
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size)
+{
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    allocations++;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *p, size_t size)
+{
+    allocations++;
+    return __libc_realloc(p, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    allocations++;
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    allocations++;
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **p, size_t alignment, size_t size)
+{
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+    allocations++;
+    void *result = __libc_memalign(alignment, size);
+    if (!result)
+        return ENOMEM;
+    *p = result;
+    return 0;
+}
+}
+
+#endif /* HOMESCREEN_ALLOC_CHECK */
@@ -0,0 +1,40 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <stdint.h>
+
+#ifdef HOMESCREEN_ALLOC_CHECK
+
+/* heap allocations made by the calling thread so far */
+uint64_t thread_allocation_count();
+
+/*
+ * Test-mode guard: aborts when the calling thread allocated from the
+ * heap between construction and destruction of an enabled check. The
+ * counter replaces malloc, calloc and realloc, so operator new and the
+ * C libraries we link are caught too. Only built with
+ * -DHOMESCREEN_ALLOC_CHECK=ON.
+ */
+class AllocationCheck
+{
+public:
+    AllocationCheck(const char *what, bool enabled);
+    ~AllocationCheck();
+
+private:
+    const char *what;
+    bool enabled;
+    uint64_t start;
+};
+
+#else
+
+class AllocationCheck
+{
+public:
+    AllocationCheck(const char *, bool) {}
+};
+
+#endif /* HOMESCREEN_ALLOC_CHECK */
+
+#endif /* ALLOCATION_COUNTER_H */
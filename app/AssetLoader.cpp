@@ -0,0 +1,169 @@
+#include "AssetLoader.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+static task_priority scheduler_priority(asset_priority priority)
+{
+    switch (priority) {
+    case ASSET_PRIORITY_VISIBLE:
+        return TASK_PRIORITY_HIGH;
+    case ASSET_PRIORITY_SOON:
+        return TASK_PRIORITY_NORMAL;
+    default:
+        return TASK_PRIORITY_LOW;
+    }
+}
+
+AssetLoader::AssetLoader(TaskScheduler *scheduler)
+{
+    this->scheduler = scheduler;
+    this->next_ticket = 1;
+    memset(&this->counters, 0, sizeof(this->counters));
+
+    this->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (this->event_fd < 0) {
+        fprintf(stderr, "creating asset loader eventfd failed: %m\n");
+        exit(1);
+    }
+}
+
+AssetLoader::~AssetLoader()
+{
+    for (auto &entry : this->in_flight) {
+        int queued = JOB_QUEUED;
+        entry.second->state.compare_exchange_strong(queued, JOB_CANCELLED);
+    }
+    this->scheduler->wait(&this->group);
+    close(this->event_fd);
+}
+
+int AssetLoader::fd() const
+{
+    return this->event_fd;
+}
+
+void AssetLoader::submit(const std::shared_ptr<asset_job> &job, asset_priority priority)
+{
+    this->scheduler->submit([this, job]() { run(job); }, scheduler_priority(priority), &this->group);
+}
+
+/* worker: the first copy of a job to get here loads it, later ones find it taken */
+void AssetLoader::run(const std::shared_ptr<asset_job> &job)
+{
+    int queued = JOB_QUEUED;
+    if (!job->state.compare_exchange_strong(queued, JOB_RUNNING))
+        return;
+
+    job->ok = job->load();
+    if (job->ok)
+        this->loaded++;
+    else
+        this->failed++;
+
+    {
+        std::lock_guard<std::mutex> lock(this->completed_mutex);
+        this->completed.push_back(job);
+    }
+
+    uint64_t one = 1;
+    if (write(this->event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        fprintf(stderr, "eventfd write failed: %m\n");
+}
+
+asset_ticket AssetLoader::request(const std::string &key, asset_priority priority, load_fn load, done_fn done)
+{
+    waiter w;
+    w.ticket = this->next_ticket++;
+    w.done = done;
+    this->counters.requested++;
+
+    auto it = this->in_flight.find(key);
+    if (it != this->in_flight.end() && it->second->state.load() != JOB_CANCELLED) {
+        std::shared_ptr<asset_job> &job = it->second;
+        job->waiters.push_back(w);
+        this->counters.deduplicated++;
+
+        /* still queued at a lower class: a second copy at the higher one races it */
+        if (priority < job->priority && job->state.load() == JOB_QUEUED) {
+            job->priority = priority;
+            submit(job, priority);
+            this->counters.promoted++;
+        }
+        return w.ticket;
+    }
+
+    std::shared_ptr<asset_job> job = std::make_shared<asset_job>();
+    job->key = key;
+    job->load = load;
+    job->priority = priority;
+    job->waiters.push_back(w);
+    this->in_flight[key] = job;
+    submit(job, priority);
+    return w.ticket;
+}
+
+void AssetLoader::cancel(asset_ticket ticket)
+{
+    for (auto it = this->in_flight.begin(); it != this->in_flight.end(); ++it) {
+        std::vector<waiter> &waiters = it->second->waiters;
+        for (size_t i = 0; i < waiters.size(); i++) {
+            if (waiters[i].ticket != ticket)
+                continue;
+
+            waiters.erase(waiters.begin() + i);
+            this->counters.cancelled++;
+
+            /* a load that already runs finishes, its result is dropped in dispatch() */
+            int queued = JOB_QUEUED;
+            if (waiters.empty() && it->second->state.compare_exchange_strong(queued, JOB_CANCELLED))
+                this->in_flight.erase(it);
+            return;
+        }
+    }
+}
+
+void AssetLoader::dispatch()
+{
+    uint64_t count;
+    while (read(this->event_fd, &count, sizeof(count)) > 0)
+        ;
+
+    std::vector<std::shared_ptr<asset_job>> done;
+    {
+        std::lock_guard<std::mutex> lock(this->completed_mutex);
+        done.swap(this->completed);
+    }
+
+    for (auto &job : done) {
+        auto it = this->in_flight.find(job->key);
+        if (it != this->in_flight.end() && it->second == job)
+            this->in_flight.erase(it);
+
+        /* completions may request more loads, the job is out of the table by now */
+        std::vector<waiter> waiters;
+        waiters.swap(job->waiters);
+        for (auto &w : waiters)
+            w.done(job->ok);
+    }
+}
+
+asset_loader_stats AssetLoader::stats() const
+{
+    asset_loader_stats s = this->counters;
+    s.loaded = this->loaded.load();
+    s.failed = this->failed.load();
+    return s;
+}
+
+void AssetLoader::dump_stats(FILE *out) const
+{
+    asset_loader_stats s = stats();
+    fprintf(out, "assets: %llu requested, %llu deduplicated, %llu promoted, %llu cancelled\n",
+            (unsigned long long) s.requested, (unsigned long long) s.deduplicated,
+            (unsigned long long) s.promoted, (unsigned long long) s.cancelled);
+    fprintf(out, "assets: %llu loaded, %llu failed\n",
+            (unsigned long long) s.loaded, (unsigned long long) s.failed);
+}
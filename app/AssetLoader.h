@@ -0,0 +1,108 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "TaskScheduler.h"
+
+/* how soon an asset is needed, mapped onto the scheduler's priorities */
+enum asset_priority {
+    ASSET_PRIORITY_VISIBLE,     /* shown as soon as it is ready */
+    ASSET_PRIORITY_SOON,        /* shown once something else happens */
+    ASSET_PRIORITY_PREFETCH     /* warms a cache, nobody waits for it */
+};
+
+/* names one request, 0 is never handed out */
+typedef uint64_t asset_ticket;
+
+struct asset_loader_stats {
+    uint64_t requested;
+    uint64_t deduplicated;
+    uint64_t promoted;
+    uint64_t cancelled;
+    uint64_t loaded;
+    uint64_t failed;
+};
+
+/*
+ * Runs asset loads on the task scheduler and reports back on the main
+ * thread. Loads are named by a key; requesting a key already in flight
+ * only adds another completion to it, at a higher priority the load is
+ * submitted again and whichever copy runs first does the work. A
+ * cancelled load that has not started is skipped.
+ *
+ * Completions are queued and signalled through an eventfd, the main
+ * loop polls fd() and calls dispatch(), which runs them on its thread,
+ * so they may change scenes directly. request(), cancel() and
+ * dispatch() belong to the main thread.
+ */
+class AssetLoader
+{
+public:
+    typedef std::function<bool()> load_fn;
+    typedef std::function<void(bool)> done_fn;
+
+    explicit AssetLoader(TaskScheduler *scheduler);
+    /* cancels what has not started and waits for what has */
+    ~AssetLoader();
+
+    asset_ticket request(const std::string &key, asset_priority priority, load_fn load, done_fn done);
+
+    /* done is not called for a cancelled ticket, the load is skipped if nobody else waits */
+    void cancel(asset_ticket ticket);
+
+    int fd() const;
+    void dispatch();
+
+    asset_loader_stats stats() const;
+    void dump_stats(FILE *out) const;
+
+private:
+    enum job_state {
+        JOB_QUEUED,
+        JOB_RUNNING,
+        JOB_CANCELLED
+    };
+
+    struct waiter {
+        asset_ticket ticket;
+        done_fn done;
+    };
+
+    struct asset_job {
+        std::string key;
+        load_fn load;
+        asset_priority priority;
+        std::atomic<int> state{JOB_QUEUED};
+        bool ok = false;
+        /* main thread only */
+        std::vector<waiter> waiters;
+    };
+
+    TaskScheduler *scheduler;
+    task_group group;
+    int event_fd;
+    asset_ticket next_ticket;
+
+    /* main thread only */
+    std::unordered_map<std::string, std::shared_ptr<asset_job>> in_flight;
+
+    std::mutex completed_mutex;
+    std::vector<std::shared_ptr<asset_job>> completed;
+
+    std::atomic<uint64_t> loaded{0};
+    std::atomic<uint64_t> failed{0};
+    asset_loader_stats counters;
+
+    void submit(const std::shared_ptr<asset_job> &job, asset_priority priority);
+    void run(const std::shared_ptr<asset_job> &job);
+};
+
+#endif /* ASSET_LOADER_H */
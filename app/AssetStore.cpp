@@ -0,0 +1,235 @@
+#include "AssetStore.h"
+#include "DiskCache.h"
+#include "TaskScheduler.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <vector>
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+static const char asset_store_magic[4] = { 'H', 'S', 'A', 'S' };
+
+AssetStore::AssetStore()
+{
+    this->fd = -1;
+    this->mapping = nullptr;
+    this->mapping_size = 0;
+}
+
+AssetStore::~AssetStore()
+{
+    close_file();
+}
+
+bool AssetStore::available()
+{
+#ifdef HAVE_LZ4
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AssetStore::close_file()
+{
+    if (this->mapping)
+        munmap(this->mapping, this->mapping_size);
+    if (this->fd >= 0)
+        close(this->fd);
+    this->mapping = nullptr;
+    this->mapping_size = 0;
+    this->fd = -1;
+}
+
+const asset_store_header *AssetStore::header() const
+{
+    return (const asset_store_header *) this->mapping;
+}
+
+const asset_entry *AssetStore::entries() const
+{
+    return (const asset_entry *) ((const uint8_t *) this->mapping + header()->index_offset);
+}
+
+const asset_chunk *AssetStore::chunks() const
+{
+    return (const asset_chunk *) (entries() + header()->entry_count);
+}
+
+bool AssetStore::open(const std::string &path)
+{
+    close_file();
+    this->path = path;
+    if (!available())
+        return false;
+
+    int store_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (store_fd < 0)
+        return true;
+
+    struct stat st;
+    if (fstat(store_fd, &st) < 0 || (size_t) st.st_size < sizeof(asset_store_header)) {
+        ::close(store_fd);
+        return false;
+    }
+
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, store_fd, 0);
+    if (mapping == MAP_FAILED) {
+        ::close(store_fd);
+        return false;
+    }
+    this->fd = store_fd;
+    this->mapping = mapping;
+    this->mapping_size = st.st_size;
+
+    /* everything the index points at must lie inside the file */
+    const asset_store_header *h = header();
+    uint64_t index_size = (uint64_t) h->entry_count * sizeof(asset_entry) +
+                          (uint64_t) h->chunk_count * sizeof(asset_chunk);
+    bool valid = memcmp(h->magic, asset_store_magic, sizeof(h->magic)) == 0 &&
+                 h->version == ASSET_STORE_VERSION &&
+                 h->index_offset % 8 == 0 && h->index_offset <= this->mapping_size &&
+                 index_size <= this->mapping_size - h->index_offset;
+    for (uint32_t i = 0; valid && i < h->chunk_count; i++) {
+        const asset_chunk &c = chunks()[i];
+        valid = c.offset <= h->index_offset && c.compressed_size <= h->index_offset - c.offset;
+    }
+    for (uint32_t i = 0; valid && i < h->entry_count; i++) {
+        const asset_entry &e = entries()[i];
+        valid = e.first_chunk <= h->chunk_count && e.chunk_count <= h->chunk_count - e.first_chunk;
+    }
+
+    if (!valid) {
+        fprintf(stderr, "asset store %s is damaged, starting over\n", path.c_str());
+        close_file();
+    }
+    return true;
+}
+
+const asset_entry *AssetStore::find(const char *name) const
+{
+    if (!this->mapping)
+        return nullptr;
+
+    for (uint32_t i = 0; i < header()->entry_count; i++) {
+        const asset_entry *e = &entries()[i];
+        if (strncmp(e->name, name, ASSET_NAME_SIZE) == 0)
+            return e;
+    }
+    return nullptr;
+}
+
+bool AssetStore::read(const asset_entry *entry, void *dst, TaskScheduler *scheduler) const
+{
+#ifdef HAVE_LZ4
+    const asset_chunk *entry_chunks = chunks() + entry->first_chunk;
+    const uint8_t *data = (const uint8_t *) this->mapping;
+    std::atomic<bool> failed{false};
+
+    if (entry->chunk_count != (entry->raw_size + ASSET_CHUNK_SIZE - 1) / ASSET_CHUNK_SIZE)
+        return false;
+
+    /* chunks are independent, each worker takes some and writes its own part of dst */
+    scheduler->parallel_for(0, (int32_t) entry->chunk_count, 1, [&](int32_t begin, int32_t end) {
+        for (int32_t i = begin; i < end; i++) {
+            const asset_chunk &c = entry_chunks[i];
+            uint64_t raw_offset = (uint64_t) i * ASSET_CHUNK_SIZE;
+            if (raw_offset + c.raw_size > entry->raw_size ||
+                LZ4_decompress_safe((const char *) data + c.offset, (char *) dst + raw_offset,
+                                    (int) c.compressed_size, (int) c.raw_size) != (int) c.raw_size)
+                failed = true;
+        }
+    });
+
+    if (failed) {
+        fprintf(stderr, "asset %.*s failed to decompress\n", ASSET_NAME_SIZE, entry->name);
+        return false;
+    }
+    return true;
+#else
+    (void) entry;
+    (void) dst;
+    (void) scheduler;
+    return false;
+#endif
+}
+
+bool AssetStore::add(const asset_entry &entry, const void *pixels)
+{
+#ifdef HAVE_LZ4
+    std::vector<uint8_t> body;
+    std::vector<asset_entry> new_entries;
+    std::vector<asset_chunk> new_chunks;
+    /* data offsets count from the start of the file, the header comes first */
+    uint64_t base = sizeof(asset_store_header);
+
+    /* keep the other entries, their compressed data is copied as is */
+    for (uint32_t i = 0; this->mapping && i < header()->entry_count; i++) {
+        asset_entry e = entries()[i];
+        if (strncmp(e.name, entry.name, ASSET_NAME_SIZE) == 0)
+            continue;
+
+        const asset_chunk *old_chunks = chunks() + e.first_chunk;
+        e.first_chunk = (uint32_t) new_chunks.size();
+        for (uint32_t k = 0; k < e.chunk_count; k++) {
+            asset_chunk c = old_chunks[k];
+            const uint8_t *compressed = (const uint8_t *) this->mapping + c.offset;
+            c.offset = base + body.size();
+            body.insert(body.end(), compressed, compressed + c.compressed_size);
+            new_chunks.push_back(c);
+        }
+        new_entries.push_back(e);
+    }
+
+    asset_entry added = entry;
+    added.first_chunk = (uint32_t) new_chunks.size();
+    added.chunk_count = 0;
+    const uint8_t *raw = (const uint8_t *) pixels;
+    std::vector<char> compressed(LZ4_compressBound(ASSET_CHUNK_SIZE));
+    for (uint64_t offset = 0; offset < entry.raw_size; offset += ASSET_CHUNK_SIZE) {
+        uint32_t raw_size = (uint32_t) (entry.raw_size - offset < ASSET_CHUNK_SIZE ? entry.raw_size - offset : ASSET_CHUNK_SIZE);
+        int size = LZ4_compress_default((const char *) raw + offset, compressed.data(),
+                                        (int) raw_size, (int) compressed.size());
+        if (size <= 0) {
+            fprintf(stderr, "compressing asset %.*s failed\n", ASSET_NAME_SIZE, entry.name);
+            return false;
+        }
+
+        asset_chunk c = { base + body.size(), (uint32_t) size, raw_size };
+        body.insert(body.end(), compressed.data(), compressed.data() + size);
+        new_chunks.push_back(c);
+        added.chunk_count++;
+    }
+    new_entries.push_back(added);
+
+    /* the index is accessed in place, keep it aligned */
+    body.resize((body.size() + 7) & ~(size_t) 7);
+
+    asset_store_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, asset_store_magic, sizeof(h.magic));
+    h.version = ASSET_STORE_VERSION;
+    h.entry_count = (uint32_t) new_entries.size();
+    h.chunk_count = (uint32_t) new_chunks.size();
+    h.index_offset = base + body.size();
+
+    const uint8_t *index = (const uint8_t *) new_entries.data();
+    body.insert(body.end(), index, index + new_entries.size() * sizeof(asset_entry));
+    index = (const uint8_t *) new_chunks.data();
+    body.insert(body.end(), index, index + new_chunks.size() * sizeof(asset_chunk));
+
+    if (!cache_write(this->path, &h, sizeof(h), body.data(), body.size(), (off_t) base))
+        return false;
+    return open(this->path);
+#else
+    (void) entry;
+    (void) pixels;
+    return false;
+#endif
+}
@@ -0,0 +1,84 @@
+#ifndef ASSET_STORE_H
+#define ASSET_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+class TaskScheduler;
+
+#define ASSET_STORE_VERSION 1
+#define ASSET_NAME_SIZE 64
+/* raw bytes per independently compressed chunk */
+#define ASSET_CHUNK_SIZE (256 * 1024)
+
+struct asset_store_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t chunk_count;
+    /* entries, then all chunks, at the end of the file */
+    uint64_t index_offset;
+};
+
+struct asset_entry {
+    char name[ASSET_NAME_SIZE];
+    int32_t width;
+    int32_t height;
+    int32_t stride;
+    uint32_t format;
+    /* set by whoever stored the entry, e.g. size and mtime of its source */
+    uint64_t tag[2];
+    uint64_t raw_size;
+    uint32_t first_chunk;
+    uint32_t chunk_count;
+};
+
+struct asset_chunk {
+    uint64_t offset;
+    uint32_t compressed_size;
+    uint32_t raw_size;
+};
+
+/*
+ * Single-file store of LZ4 compressed pixel assets, for storage where
+ * reading is slower than decompressing. The file is mapped; an entry is
+ * a run of independently compressed chunks that decompress in parallel
+ * on the scheduler straight into the destination, typically the mapping
+ * of a shm buffer. Adding an entry rewrites the file, copying the other
+ * entries' compressed data as is.
+ *
+ * Needs liblz4 at build time (HAVE_LZ4), otherwise every open fails.
+ */
+class AssetStore
+{
+public:
+    AssetStore();
+    ~AssetStore();
+
+    /* a missing file is an empty store */
+    bool open(const std::string &path);
+
+    const asset_entry *find(const char *name) const;
+
+    /* decompresses entry into dst, which holds at least entry->raw_size bytes */
+    bool read(const asset_entry *entry, void *dst, TaskScheduler *scheduler) const;
+
+    /* adds or replaces an entry, compressing its pixels */
+    bool add(const asset_entry &entry, const void *pixels);
+
+    static bool available();
+
+private:
+    std::string path;
+    int fd;
+    void *mapping;
+    size_t mapping_size;
+
+    const asset_store_header *header() const;
+    const asset_entry *entries() const;
+    const asset_chunk *chunks() const;
+    void close_file();
+};
+
+#endif /* ASSET_STORE_H */
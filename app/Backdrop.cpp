@@ -0,0 +1,202 @@
+#include "Backdrop.h"
+#include "DiskCache.h"
+#include "PixelKernels.h"
+#include "TaskScheduler.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+/* rows generated per task */
+#define BACKDROP_ROW_GRAIN 16
+#define STRIPE_PERIOD 96
+/* the largest noise cell, each further octave halves it */
+#define NOISE_CELL_SHIFT 8
+#define NOISE_OCTAVES 3
+
+static const char backdrop_magic[4] = { 'H', 'S', 'B', 'D' };
+
+/* indexed by theme, day first */
+static const uint32_t backdrop_colors[2][2] = {
+    { 0xffd5dce4, 0xff8795a6 },
+    { 0xff1c2430, 0xff05070a }
+};
+
+/* 8x8 Bayer matrix, thresholds 0..63 */
+static const uint8_t bayer[8][8] = {
+    {  0, 32,  8, 40,  2, 34, 10, 42 },
+    { 48, 16, 56, 24, 50, 18, 58, 26 },
+    { 12, 44,  4, 36, 14, 46,  6, 38 },
+    { 60, 28, 52, 20, 62, 30, 54, 22 },
+    {  3, 35, 11, 43,  1, 33,  9, 41 },
+    { 51, 19, 59, 27, 49, 17, 57, 25 },
+    { 15, 47,  7, 39, 13, 45,  5, 37 },
+    { 63, 31, 55, 23, 61, 29, 53, 21 }
+};
+
+const CachedImage &Backdrop::cached_image() const
+{
+    return this->cached;
+}
+
+static bool parse_color(const char *text, uint32_t &color)
+{
+    if (*text == '#')
+        text++;
+    char *end;
+    unsigned long value = strtoul(text, &end, 16);
+    if (end - text != 6 || (*end && *end != ':'))
+        return false;
+    color = 0xff000000 | (uint32_t) value;
+    return true;
+}
+
+bool Backdrop::parse(const char *text, int32_t theme, backdrop_spec &spec)
+{
+    static const struct {
+        const char *name;
+        backdrop_kind kind;
+    } kinds[] = {
+        { "linear", BACKDROP_LINEAR },
+        { "radial", BACKDROP_RADIAL },
+        { "noise", BACKDROP_NOISE },
+        { "stripes", BACKDROP_STRIPES }
+    };
+
+    const char *colon = strchr(text, ':');
+    size_t length = colon ? (size_t) (colon - text) : strlen(text);
+    bool found = false;
+    for (auto &k : kinds) {
+        if (strlen(k.name) == length && strncmp(text, k.name, length) == 0) {
+            spec.kind = k.kind;
+            found = true;
+        }
+    }
+    if (!found) {
+        fprintf(stderr, "unknown background kind in '%s'\n", text);
+        return false;
+    }
+
+    theme = theme ? 1 : 0;
+    if (!colon) {
+        spec.from = backdrop_colors[theme][0];
+        spec.to = backdrop_colors[theme][1];
+        return true;
+    }
+
+    const char *second = strchr(colon + 1, ':');
+    if (!second || !parse_color(colon + 1, spec.from) || !parse_color(second + 1, spec.to)) {
+        fprintf(stderr, "background '%s' needs two RRGGBB colors\n", text);
+        return false;
+    }
+    if (theme) {
+        /* a quarter of the brightness at night */
+        spec.from = 0xff000000 | ((spec.from >> 2) & 0x003f3f3f);
+        spec.to = 0xff000000 | ((spec.to >> 2) & 0x003f3f3f);
+    }
+    return true;
+}
+
+static uint32_t lattice(int32_t x, int32_t y, uint32_t octave)
+{
+    uint32_t h = (uint32_t) x * 0x8da6b343u ^ (uint32_t) y * 0xd8163841u ^ octave * 0xcb1ab31fu;
+    h ^= h >> 13;
+    h *= 0x85ebca6bu;
+    h ^= h >> 16;
+    return h & 0xffff;
+}
+
+/* 3f^2 - 2f^3 in 16.16 fixed point */
+static int64_t smooth(int64_t f)
+{
+    return f * f / 65536 * (3 * 65536 - 2 * f) / 65536;
+}
+
+static uint16_t noise(int32_t x, int32_t y)
+{
+    int64_t sum = 0, total = 0;
+    for (int32_t octave = 0; octave < NOISE_OCTAVES; octave++) {
+        int32_t shift = NOISE_CELL_SHIFT - octave;
+        int32_t cx = x >> shift, cy = y >> shift;
+        int64_t fx = smooth((int64_t) (x & ((1 << shift) - 1)) << (16 - shift));
+        int64_t fy = smooth((int64_t) (y & ((1 << shift) - 1)) << (16 - shift));
+
+        int64_t a = lattice(cx, cy, octave), b = lattice(cx + 1, cy, octave);
+        int64_t c = lattice(cx, cy + 1, octave), d = lattice(cx + 1, cy + 1, octave);
+        int64_t top = a + (b - a) * fx / 65536;
+        int64_t bottom = c + (d - c) * fx / 65536;
+
+        /* coarse octaves weigh most */
+        int32_t weight = 1 << (NOISE_OCTAVES - 1 - octave);
+        sum += (top + (bottom - top) * fy / 65536) * weight;
+        total += weight;
+    }
+    return (uint16_t) (sum / total);
+}
+
+void Backdrop::generate(const backdrop_spec &spec, int32_t width, int32_t height,
+                        uint32_t *pixels, TaskScheduler *scheduler)
+{
+    int64_t diagonal = width + height > 2 ? width + height - 2 : 1;
+    float cx = width * 0.5f, cy = height * 0.5f;
+    float radius = sqrtf(cx * cx + cy * cy);
+
+    scheduler->parallel_for(0, height, BACKDROP_ROW_GRAIN, [&](int32_t begin, int32_t end) {
+        std::vector<uint16_t> t(width);
+        for (int32_t y = begin; y < end; y++) {
+            for (int32_t x = 0; x < width; x++) {
+                switch (spec.kind) {
+                case BACKDROP_LINEAR:
+                    t[x] = (uint16_t) ((int64_t) (x + y) * 65535 / diagonal);
+                    break;
+                case BACKDROP_RADIAL: {
+                    float dx = x + 0.5f - cx, dy = y + 0.5f - cy;
+                    float r = sqrtf(dx * dx + dy * dy) / radius;
+                    t[x] = (uint16_t) (r >= 1.0f ? 65535 : r * 65535.0f);
+                    break;
+                }
+                case BACKDROP_NOISE:
+                    t[x] = noise(x, y);
+                    break;
+                case BACKDROP_STRIPES: {
+                    int32_t phase = (x + y) % STRIPE_PERIOD;
+                    t[x] = (uint16_t) (abs(2 * phase - STRIPE_PERIOD) * 65535 / STRIPE_PERIOD);
+                    break;
+                }
+                }
+            }
+            gradient_span(pixels + (size_t) y * width, t.data(), width, spec.from, spec.to, bayer[y & 7]);
+        }
+    });
+}
+
+bool Backdrop::load(const backdrop_spec &spec, int32_t width, int32_t height, TaskScheduler *scheduler)
+{
+    char text[96];
+    snprintf(text, sizeof(text), "%d|%08x|%08x|%dx%d|%d", (int) spec.kind, spec.from, spec.to,
+             width, height, BACKDROP_CACHE_VERSION);
+    uint64_t key = cache_hash(text);
+
+    this->cached.unmap();
+    std::string directory = cache_directory();
+    std::string cache_path;
+    if (!directory.empty()) {
+        char name[64];
+        snprintf(name, sizeof(name), "/backdrop-%016llx.raw", (unsigned long long) key);
+        cache_path = directory + name;
+
+        if (this->cached.map(cache_path, backdrop_magic, BACKDROP_CACHE_VERSION, key, width, height)) {
+            fprintf(stderr, "Mapped cached background %s\n", cache_path.c_str());
+            return true;
+        }
+    }
+
+    fprintf(stderr, "Generating %dx%d background\n", width, height);
+    std::vector<uint32_t> pixels((size_t) width * height);
+    generate(spec, width, height, pixels.data(), scheduler);
+
+    if (!this->cached.store(cache_path, backdrop_magic, BACKDROP_CACHE_VERSION, key, width, height, pixels))
+        fprintf(stderr, "Background not cached, it is kept in memory\n");
+    return true;
+}
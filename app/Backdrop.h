@@ -0,0 +1,54 @@
+#ifndef BACKDROP_H
+#define BACKDROP_H
+
+#include <stdint.h>
+#include "CachedImage.h"
+
+class TaskScheduler;
+
+#define BACKDROP_CACHE_VERSION 2
+
+enum backdrop_kind {
+    BACKDROP_LINEAR,    /* top left to bottom right */
+    BACKDROP_RADIAL,    /* centre to the corners */
+    BACKDROP_NOISE,     /* smooth value noise, three octaves */
+    BACKDROP_STRIPES    /* diagonal stripes, tiled */
+};
+
+struct backdrop_spec {
+    backdrop_kind kind;
+    uint32_t from;
+    uint32_t to;
+};
+
+/*
+ * Procedural background: a gradient, noise or pattern between two
+ * colors, generated once per spec and output size. Rows are generated
+ * in parallel on the scheduler and colored with ordered dithering, so
+ * slow gradients do not band. The result is a CachedImage keyed by the
+ * spec and the size, so later loads, in this run or the next boot, only
+ * map it.
+ */
+class Backdrop
+{
+public:
+    /*
+     * "<kind>[:<from>:<to>]" with kind linear, radial, noise or stripes
+     * and colors as RRGGBB. Without colors the theme's own are used,
+     * given colors are darkened for the night theme.
+     */
+    static bool parse(const char *text, int32_t theme, backdrop_spec &spec);
+
+    /* generates on a cache miss, which takes a while on large outputs */
+    bool load(const backdrop_spec &spec, int32_t width, int32_t height, TaskScheduler *scheduler);
+
+    const CachedImage &cached_image() const;
+
+private:
+    CachedImage cached;
+
+    static void generate(const backdrop_spec &spec, int32_t width, int32_t height,
+                         uint32_t *pixels, TaskScheduler *scheduler);
+};
+
+#endif /* BACKDROP_H */
@@ -0,0 +1,79 @@
+#include "BufferDiff.h"
+#include <string.h>
+
+/* pixels compared per step, the inner loops vectorize */
+#define DIFF_BLOCK 8
+
+static int32_t first_difference(const uint32_t *a, const uint32_t *b, int32_t count)
+{
+    int32_t x = 0;
+    for (; x + DIFF_BLOCK <= count; x += DIFF_BLOCK) {
+        uint32_t diff = 0;
+        for (int i = 0; i < DIFF_BLOCK; i++)
+            diff |= a[x + i] ^ b[x + i];
+        if (diff)
+            break;
+    }
+    for (; x < count; x++) {
+        if (a[x] != b[x])
+            return x;
+    }
+    return -1;
+}
+
+static int32_t last_difference(const uint32_t *a, const uint32_t *b, int32_t count)
+{
+    int32_t x = count;
+    for (; x - DIFF_BLOCK >= 0; x -= DIFF_BLOCK) {
+        uint32_t diff = 0;
+        for (int i = 1; i <= DIFF_BLOCK; i++)
+            diff |= a[x - i] ^ b[x - i];
+        if (diff)
+            break;
+    }
+    for (x--; x >= 0; x--) {
+        if (a[x] != b[x])
+            return x;
+    }
+    return -1;
+}
+
+bool diff_buffers(const uint32_t *current, const uint32_t *previous, int32_t stride,
+                  int32_t width, int32_t height, std::vector<rect> &damage)
+{
+    bool changed = false;
+    int32_t band_y = -1;
+    int32_t band_left = 0;
+    int32_t band_right = 0;
+
+    for (int32_t y = 0; y <= height; y++) {
+        int32_t left = -1;
+        int32_t right = -1;
+
+        if (y < height) {
+            const uint32_t *a = current + y * stride;
+            const uint32_t *b = previous + y * stride;
+            if (memcmp(a, b, width * sizeof(uint32_t)) != 0) {
+                left = first_difference(a, b, width);
+                right = last_difference(a, b, width);
+            }
+        }
+
+        if (left >= 0) {
+            if (band_y < 0) {
+                band_y = y;
+                band_left = left;
+                band_right = right;
+            } else {
+                band_left = left < band_left ? left : band_left;
+                band_right = right > band_right ? right : band_right;
+            }
+        } else if (band_y >= 0) {
+            damage_add(damage, make_rect(band_left, band_y, band_right - band_left + 1, y - band_y));
+            band_y = -1;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
@@ -0,0 +1,18 @@
+#ifndef BUFFER_DIFF_H
+#define BUFFER_DIFF_H
+
+#include <stdint.h>
+#include <vector>
+#include "Geometry.h"
+
+/*
+ * Compares two equally sized frames row by row and adds the changed
+ * area to damage: consecutive changed rows form one band spanning the
+ * leftmost to the rightmost changed pixel. Unchanged rows cost one
+ * memcmp, which libc runs with the widest vectors available. Returns
+ * false when the frames are identical.
+ */
+bool diff_buffers(const uint32_t *current, const uint32_t *previous, int32_t stride,
+                  int32_t width, int32_t height, std::vector<rect> &damage);
+
+#endif /* BUFFER_DIFF_H */
@@ -0,0 +1,118 @@
+#include "CachedImage.h"
+#include <string.h>
+#include <wayland-client.h>
+
+CachedImage::CachedImage()
+{
+    memset(&this->header, 0, sizeof(this->header));
+}
+
+CachedImage::~CachedImage()
+{
+    unmap();
+}
+
+void CachedImage::unmap()
+{
+    cache_unmap(this->cache);
+    std::vector<uint32_t>().swap(this->memory);
+}
+
+void CachedImage::fill_header(cached_image_header &h, const char *magic, uint32_t version, uint64_t key,
+                              int32_t width, int32_t height, uint64_t data_offset)
+{
+    memset(&h, 0, sizeof(h));
+    if (magic)
+        memcpy(h.magic, magic, sizeof(h.magic));
+    h.version = version;
+    h.key = key;
+    h.width = width;
+    h.height = height;
+    h.stride = width * 4;
+    h.format = WL_SHM_FORMAT_XRGB8888;
+    h.data_offset = data_offset;
+}
+
+bool CachedImage::map(const std::string &path, const char *magic, uint32_t version, uint64_t key,
+                      int32_t width, int32_t height)
+{
+    unmap();
+    cached_image_header h;
+    bool mapped = cache_map(path, &h, sizeof(h), [&](uint64_t &data_offset, uint64_t &data_size) {
+        data_offset = h.data_offset;
+        data_size = (uint64_t) h.stride * h.height;
+        return memcmp(h.magic, magic, sizeof(h.magic)) == 0 && h.version == version && h.key == key &&
+               h.width == width && h.height == height && h.stride == width * 4 &&
+               h.format == WL_SHM_FORMAT_XRGB8888;
+    }, this->cache);
+    if (mapped)
+        this->header = h;
+    return mapped;
+}
+
+bool CachedImage::write(const std::string &path, const char *magic, uint32_t version, uint64_t key,
+                        int32_t width, int32_t height, const uint32_t *pixels)
+{
+    /* page-aligned and stride == width * 4, as a wl_shm_pool buffer wants it */
+    cached_image_header h;
+    fill_header(h, magic, version, key, width, height, CACHE_PAGE_SIZE);
+    return cache_write(path, &h, sizeof(h), pixels, (size_t) h.stride * height, (off_t) h.data_offset);
+}
+
+bool CachedImage::store(const std::string &path, const char *magic, uint32_t version, uint64_t key,
+                        int32_t width, int32_t height, std::vector<uint32_t> &pixels)
+{
+    if (!path.empty() && write(path, magic, version, key, width, height, pixels.data()) &&
+        map(path, magic, version, key, width, height))
+        return true;
+
+    keep(width, height, pixels);
+    return false;
+}
+
+void CachedImage::keep(int32_t width, int32_t height, std::vector<uint32_t> &pixels)
+{
+    unmap();
+    fill_header(this->header, nullptr, 0, 0, width, height, 0);
+    this->memory.swap(pixels);
+}
+
+void CachedImage::adopt(int fd, void *data, int32_t width, int32_t height)
+{
+    unmap();
+    fill_header(this->header, nullptr, 0, 0, width, height, 0);
+    this->cache.fd = fd;
+    this->cache.data = data;
+    this->cache.size = (size_t) this->header.stride * height;
+}
+
+bool CachedImage::loaded() const
+{
+    return this->cache.data != nullptr || !this->memory.empty();
+}
+
+scene_image CachedImage::image() const
+{
+    scene_image image;
+    if (this->cache.data)
+        image.pixels = (const uint32_t *) ((const uint8_t *) this->cache.data + this->header.data_offset);
+    else
+        image.pixels = this->memory.data();
+    image.width = this->header.width;
+    image.height = this->header.height;
+    image.stride = this->header.stride / 4;
+    image.opaque = true;
+    return image;
+}
+
+struct file_image CachedImage::file() const
+{
+    struct file_image file;
+    file.pixels = image().pixels;
+    file.fd = this->cache.fd;
+    file.offset = (off_t) this->header.data_offset;
+    file.width = this->header.width;
+    file.height = this->header.height;
+    file.stride = this->header.stride;
+    return file;
+}
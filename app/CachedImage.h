@@ -0,0 +1,74 @@
+#ifndef CACHED_IMAGE_H
+#define CACHED_IMAGE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "DiskCache.h"
+#include "SceneGraph.h"
+#include "ExampleScene.h"
+
+/* start of an image cache file, the XRGB8888 pixels follow at data_offset */
+struct cached_image_header {
+    char magic[4];
+    uint32_t version;
+    /* hash of whatever the pixels were made from */
+    uint64_t key;
+    int32_t width;
+    int32_t height;
+    int32_t stride;
+    uint32_t format;
+    uint64_t data_offset;
+};
+
+/*
+ * An output-sized XRGB8888 image from the cache directory. It is mapped
+ * from its cache file, which goes to the compositor as is, or kept in
+ * memory when the file cannot be written; the scene draws either the
+ * same way. magic and version tell the kinds of image apart, key names
+ * the content.
+ */
+class CachedImage
+{
+public:
+    CachedImage();
+    ~CachedImage();
+
+    /* drops the current image and maps path if it holds this content at this size */
+    bool map(const std::string &path, const char *magic, uint32_t version, uint64_t key,
+             int32_t width, int32_t height);
+
+    /*
+     * Writes pixels to path and maps it. Without a path, or when that
+     * fails, the pixels are moved into memory instead; returns whether
+     * they were cached.
+     */
+    bool store(const std::string &path, const char *magic, uint32_t version, uint64_t key,
+               int32_t width, int32_t height, std::vector<uint32_t> &pixels);
+
+    /* takes over pixels as the image, without a file */
+    void keep(int32_t width, int32_t height, std::vector<uint32_t> &pixels);
+
+    /* takes over a mapped shm file of width * height pixels from offset 0 */
+    void adopt(int fd, void *data, int32_t width, int32_t height);
+
+    static bool write(const std::string &path, const char *magic, uint32_t version, uint64_t key,
+                      int32_t width, int32_t height, const uint32_t *pixels);
+
+    bool loaded() const;
+    scene_image image() const;
+    /* for handing to the compositor; fd is -1 for an image in memory */
+    struct file_image file() const;
+    void unmap();
+
+private:
+    mapped_cache_file cache;
+    std::vector<uint32_t> memory;
+    cached_image_header header;
+
+    /* magic may be null, for an image without a file */
+    static void fill_header(cached_image_header &h, const char *magic, uint32_t version, uint64_t key,
+                            int32_t width, int32_t height, uint64_t data_offset);
+};
+
+#endif /* CACHED_IMAGE_H */
@@ -0,0 +1,129 @@
+#include "DiskCache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::string cache_directory()
+{
+    std::string path;
+    const char *cache_home = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+
+    if (cache_home && *cache_home) {
+        path = cache_home;
+    } else if (home && *home) {
+        path = std::string(home) + "/.cache";
+        mkdir(path.c_str(), 0700);
+    } else {
+        return std::string();
+    }
+
+    path += "/homescreen";
+    if (mkdir(path.c_str(), 0700) < 0 && errno != EEXIST) {
+        fprintf(stderr, "creating cache directory %s failed: %m\n", path.c_str());
+        return std::string();
+    }
+    return path;
+}
+
+uint64_t cache_hash(const char *text)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (; *text; text++) {
+        hash ^= (uint8_t) *text;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static bool write_all(int fd, const void *data, size_t size, off_t offset)
+{
+    const uint8_t *bytes = (const uint8_t *) data;
+    while (size) {
+        ssize_t n = pwrite(fd, bytes, size, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        bytes += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+bool cache_write(const std::string &path, const void *header, size_t header_size,
+                 const void *data, size_t size, off_t data_offset)
+{
+    std::string temporary = path + ".XXXXXX";
+    int fd = mkostemp(&temporary[0], O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "creating cache file for %s failed: %m\n", path.c_str());
+        return false;
+    }
+
+    bool written = write_all(fd, header, header_size, 0) &&
+                   write_all(fd, data, size, data_offset) &&
+                   fdatasync(fd) == 0;
+    close(fd);
+
+    if (!written || rename(temporary.c_str(), path.c_str()) < 0) {
+        fprintf(stderr, "writing cache file %s failed: %m\n", path.c_str());
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool cache_map(const std::string &path, void *header, size_t header_size,
+               const std::function<bool(uint64_t &data_offset, uint64_t &data_size)> &check,
+               mapped_cache_file &file)
+{
+    /*
+     * Read-write because compositors map shm pools writable; the fd is
+     * handed over as is. Unlike a memfd, a regular file cannot be sealed
+     * against truncation, the cache directory is private to the user.
+     */
+    int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    uint64_t data_offset = 0, data_size = 0;
+    struct stat st;
+    if (pread(fd, header, header_size, 0) != (ssize_t) header_size ||
+        !check(data_offset, data_size) ||
+        data_offset < header_size || data_offset % CACHE_PAGE_SIZE != 0 ||
+        fstat(fd, &st) < 0 || (uint64_t) st.st_size < data_offset ||
+        (uint64_t) st.st_size - data_offset < data_size) {
+        close(fd);
+        return false;
+    }
+
+    size_t size = (size_t) (data_offset + data_size);
+    void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+
+    cache_unmap(file);
+    file.fd = fd;
+    file.data = data;
+    file.size = size;
+    return true;
+}
+
+void cache_unmap(mapped_cache_file &file)
+{
+    if (file.data)
+        munmap(file.data, file.size);
+    if (file.fd >= 0)
+        close(file.fd);
+    file.fd = -1;
+    file.data = nullptr;
+    file.size = 0;
+}
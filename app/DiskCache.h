@@ -0,0 +1,52 @@
+#ifndef DISK_CACHE_H
+#define DISK_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <functional>
+#include <string>
+
+/*
+ * Helpers for the pre-converted asset caches. Cache files hold a small
+ * header followed by the data at a page-aligned offset, so the data can
+ * be mapped or handed to the compositor as is.
+ */
+
+#define CACHE_PAGE_SIZE 4096
+
+/* $XDG_CACHE_HOME/homescreen or ~/.cache/homescreen, created on demand; empty if unusable */
+std::string cache_directory();
+
+/* FNV-1a, for naming cache files after their sources */
+uint64_t cache_hash(const char *text);
+
+/*
+ * Writes header at offset 0 and data at data_offset into a temporary
+ * file that is renamed over path, so readers never see partial files.
+ */
+bool cache_write(const std::string &path, const void *header, size_t header_size,
+                 const void *data, size_t size, off_t data_offset);
+
+/* a cache file kept open and mapped read-only */
+struct mapped_cache_file {
+    int fd = -1;
+    void *data = nullptr;
+    size_t size = 0;
+};
+
+/*
+ * Opens path and reads its first header_size bytes into header. check
+ * compares them with the content wanted and sets where the data starts
+ * and how long it is; the start must be page-aligned. On success the
+ * file is mapped up to the end of the data and stays open, so its fd
+ * can be handed to the compositor.
+ */
+bool cache_map(const std::string &path, void *header, size_t header_size,
+               const std::function<bool(uint64_t &data_offset, uint64_t &data_size)> &check,
+               mapped_cache_file &file);
+
+/* unmaps and closes, file is empty afterwards */
+void cache_unmap(mapped_cache_file &file);
+
+#endif /* DISK_CACHE_H */
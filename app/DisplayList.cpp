@@ -0,0 +1,280 @@
+#include "DisplayList.h"
+#include "PixelKernels.h"
+#include <algorithm>
+
+/* lists longer than this skip the quadratic occlusion and batching passes */
+#define MAX_OPTIMIZED_OPS 256
+
+DisplayList::DisplayList()
+    : arena(16 * 1024), ops(&arena), batched(&arena), sorted(&arena), previous_sorted(&arena)
+{
+}
+
+void DisplayList::reset()
+{
+    this->ops.clear();
+    this->batched.clear();
+    this->sorted.clear();
+    this->previous_sorted.clear();
+    this->arena.reset();
+}
+
+size_t DisplayList::size() const
+{
+    return this->ops.size();
+}
+
+size_t DisplayList::batched_size() const
+{
+    return this->batched.size();
+}
+
+const draw_op *DisplayList::sole_op() const
+{
+    return this->batched.size() == 1 ? &this->batched[0] : nullptr;
+}
+
+draw_op &DisplayList::append(uint8_t type, uint32_t key, const rect &area)
+{
+    draw_op blank;
+    this->ops.push_back(blank);
+    draw_op &op = this->ops.back();
+    op.type = type;
+    op.key = key;
+    op.version = 0;
+    op.area = area;
+    op.color = 0;
+    op.src = nullptr;
+    op.src_stride = 0;
+    op.src_x = 0;
+    op.src_y = 0;
+    op.src_width = 0;
+    op.src_height = 0;
+    op.target = area;
+    op.mask = nullptr;
+    return op;
+}
+
+void DisplayList::fill(uint32_t key, const rect &area, uint32_t color)
+{
+    if (rect_empty(area) || (color >> 24) == 0)
+        return;
+
+    draw_op &op = append((color >> 24) == 0xff ? DRAW_OP_FILL : DRAW_OP_BLEND_FILL, key, area);
+    op.color = color;
+}
+
+void DisplayList::blit(uint32_t key, uint32_t version, const rect &area, const uint32_t *src,
+                       int32_t src_stride, int32_t src_x, int32_t src_y, bool opaque)
+{
+    if (rect_empty(area) || !src)
+        return;
+
+    draw_op &op = append(opaque ? DRAW_OP_BLIT : DRAW_OP_BLEND, key, area);
+    op.version = version;
+    op.src = src;
+    op.src_stride = src_stride;
+    op.src_x = src_x;
+    op.src_y = src_y;
+}
+
+void DisplayList::blit_scaled(uint32_t key, uint32_t version, const rect &area, const rect &target,
+                              const uint32_t *src, int32_t src_stride, int32_t src_width, int32_t src_height)
+{
+    if (rect_empty(area) || !src)
+        return;
+
+    draw_op &op = append(DRAW_OP_BLIT_SCALED, key, area);
+    op.version = version;
+    op.src = src;
+    op.src_stride = src_stride;
+    op.src_width = src_width;
+    op.src_height = src_height;
+    op.target = target;
+}
+
+void DisplayList::mask(uint32_t key, uint32_t version, const rect &area, const uint8_t *mask,
+                       int32_t mask_stride, int32_t src_x, int32_t src_y, uint32_t color)
+{
+    if (rect_empty(area) || !mask || (color >> 24) == 0)
+        return;
+
+    draw_op &op = append(DRAW_OP_MASK, key, area);
+    op.version = version;
+    op.color = color;
+    op.mask = mask;
+    op.src_stride = mask_stride;
+    op.src_x = src_x;
+    op.src_y = src_y;
+}
+
+static bool same_op(const draw_op &a, const draw_op &b)
+{
+    return a.type == b.type && a.version == b.version && a.color == b.color &&
+           a.area.x == b.area.x && a.area.y == b.area.y &&
+           a.area.width == b.area.width && a.area.height == b.area.height &&
+           a.src == b.src && a.src_stride == b.src_stride &&
+           a.src_x == b.src_x && a.src_y == b.src_y &&
+           a.src_width == b.src_width && a.src_height == b.src_height &&
+           a.target.x == b.target.x && a.target.y == b.target.y &&
+           a.target.width == b.target.width && a.target.height == b.target.height &&
+           a.mask == b.mask;
+}
+
+void DisplayList::sort_keys(const ArenaVector<draw_op> &list, ArenaVector<key_index> &out)
+{
+    out.clear();
+    for (uint32_t i = 0; i < list.size(); i++) {
+        key_index entry = { list[i].key, i };
+        out.push_back(entry);
+    }
+    std::sort(out.begin(), out.end(), [](const key_index &a, const key_index &b) {
+        return a.key < b.key || (a.key == b.key && a.index < b.index);
+    });
+}
+
+void DisplayList::diff(const DisplayList &previous, std::vector<rect> &damage)
+{
+    /* both key tables are scratch space in this frame's arena */
+    sort_keys(this->ops, this->sorted);
+    sort_keys(previous.ops, this->previous_sorted);
+
+    size_t i = 0, j = 0;
+    while (i < this->sorted.size() || j < this->previous_sorted.size()) {
+        if (j == this->previous_sorted.size() ||
+            (i < this->sorted.size() && this->sorted[i].key < this->previous_sorted[j].key)) {
+            /* new op */
+            damage_add(damage, this->ops[this->sorted[i++].index].area);
+        } else if (i == this->sorted.size() || this->previous_sorted[j].key < this->sorted[i].key) {
+            /* op went away */
+            damage_add(damage, previous.ops[this->previous_sorted[j++].index].area);
+        } else {
+            const draw_op &now = this->ops[this->sorted[i++].index];
+            const draw_op &before = previous.ops[this->previous_sorted[j++].index];
+            if (!same_op(now, before)) {
+                damage_add(damage, before.area);
+                damage_add(damage, now.area);
+            }
+        }
+    }
+}
+
+static bool is_opaque(const draw_op &op)
+{
+    return op.type == DRAW_OP_FILL || op.type == DRAW_OP_BLIT || op.type == DRAW_OP_BLIT_SCALED;
+}
+
+/* merges b into a when the two ops draw one rectangle between them */
+static bool try_merge(draw_op &a, const draw_op &b)
+{
+    if (a.type != b.type)
+        return false;
+
+    bool horizontal = a.area.y == b.area.y && a.area.height == b.area.height &&
+                      a.area.x + a.area.width == b.area.x;
+    bool vertical = a.area.x == b.area.x && a.area.width == b.area.width &&
+                    a.area.y + a.area.height == b.area.y;
+    if (!horizontal && !vertical)
+        return false;
+
+    switch (a.type) {
+    case DRAW_OP_FILL:
+    case DRAW_OP_BLEND_FILL:
+        if (a.color != b.color)
+            return false;
+        break;
+    case DRAW_OP_BLIT:
+    case DRAW_OP_BLEND:
+        /* same source and the same source to destination offset */
+        if (a.src != b.src || a.src_stride != b.src_stride ||
+            b.src_x - a.src_x != b.area.x - a.area.x ||
+            b.src_y - a.src_y != b.area.y - a.area.y)
+            return false;
+        break;
+    default:
+        return false;
+    }
+
+    a.area = rect_bounds(a.area, b.area);
+    return true;
+}
+
+void DisplayList::optimize()
+{
+    this->batched.clear();
+
+    size_t count = this->ops.size();
+    if (count > MAX_OPTIMIZED_OPS) {
+        for (auto &op : this->ops)
+            this->batched.push_back(op);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const draw_op &op = this->ops[i];
+
+        /* skip ops fully covered by a later opaque op */
+        bool occluded = false;
+        for (size_t k = i + 1; k < count && !occluded; k++)
+            occluded = is_opaque(this->ops[k]) && rect_contains(this->ops[k].area, op.area);
+        if (occluded)
+            continue;
+
+        /*
+         * Look back for an op this one merges with. Moving op before the
+         * ops in between is only allowed when it overlaps none of them.
+         */
+        bool merged = false;
+        for (size_t j = this->batched.size(); j-- > 0;) {
+            draw_op candidate = this->batched[j];
+            if (try_merge(candidate, op)) {
+                this->batched[j] = candidate;
+                merged = true;
+                break;
+            }
+            if (!rect_empty(rect_intersect(this->batched[j].area, op.area)))
+                break;
+        }
+        if (!merged)
+            this->batched.push_back(op);
+    }
+}
+
+static void replay_op(const draw_op &op, uint32_t *pixels, int32_t stride, const rect &clip)
+{
+    rect area = rect_intersect(op.area, clip);
+    if (rect_empty(area))
+        return;
+
+    int32_t src_x = op.src_x + area.x - op.area.x;
+    int32_t src_y = op.src_y + area.y - op.area.y;
+
+    switch (op.type) {
+    case DRAW_OP_FILL:
+        fill_rect(pixels, stride, area, op.color);
+        break;
+    case DRAW_OP_BLEND_FILL:
+        blend_color(pixels, stride, area, op.color);
+        break;
+    case DRAW_OP_BLIT:
+        blit(pixels, stride, area, op.src, op.src_stride, src_x, src_y);
+        break;
+    case DRAW_OP_BLEND:
+        blend(pixels, stride, area, op.src, op.src_stride, src_x, src_y);
+        break;
+    case DRAW_OP_BLIT_SCALED:
+        blit_scaled(pixels, stride, area, op.target, op.src, op.src_stride, op.src_width, op.src_height);
+        break;
+    case DRAW_OP_MASK:
+        blend_mask(pixels, stride, area, op.color, op.mask, op.src_stride, src_x, src_y);
+        break;
+    }
+}
+
+void DisplayList::replay(uint32_t *pixels, int32_t stride, const std::vector<rect> &region) const
+{
+    for (auto &clip : region) {
+        for (auto &op : this->batched)
+            replay_op(op, pixels, stride, clip);
+    }
+}
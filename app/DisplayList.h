@@ -0,0 +1,90 @@
+#ifndef DISPLAY_LIST_H
+#define DISPLAY_LIST_H
+
+#include <stdint.h>
+#include <vector>
+#include "Geometry.h"
+#include "FrameArena.h"
+
+enum draw_op_type {
+    DRAW_OP_FILL,           /* opaque color */
+    DRAW_OP_BLEND_FILL,     /* translucent premultiplied color */
+    DRAW_OP_BLIT,           /* opaque image copy */
+    DRAW_OP_BLEND,          /* premultiplied image, source over */
+    DRAW_OP_BLIT_SCALED,    /* opaque image stretched over area */
+    DRAW_OP_MASK            /* color through an 8-bit coverage mask, e.g. text */
+};
+
+struct draw_op {
+    uint8_t type;
+    /* identity of the producer (e.g. a scene node), used for diffing */
+    uint32_t key;
+    /* bumped by the producer when source pixels change in place */
+    uint32_t version;
+    rect area;
+    uint32_t color;
+    const uint32_t *src;
+    int32_t src_stride;
+    int32_t src_x;
+    int32_t src_y;
+    int32_t src_width;
+    int32_t src_height;
+    /* what DRAW_OP_BLIT_SCALED stretches the source over, area may be clipped from it */
+    rect target;
+    /* coverage of DRAW_OP_MASK, addressed like src */
+    const uint8_t *mask;
+};
+
+/*
+ * Draw commands recorded for one frame into the list's own arena, which
+ * reset() rewinds, so steady-state recording does not allocate. The
+ * recorded order is painter's order; optimize() derives a replay list
+ * where occluded ops are dropped and ops that can merge are moved next
+ * to each other, only ever past ops they do not overlap.
+ */
+class DisplayList
+{
+public:
+    DisplayList();
+
+    void reset();
+
+    void fill(uint32_t key, const rect &area, uint32_t color);
+    void blit(uint32_t key, uint32_t version, const rect &area, const uint32_t *src,
+              int32_t src_stride, int32_t src_x, int32_t src_y, bool opaque);
+    void blit_scaled(uint32_t key, uint32_t version, const rect &area, const rect &target,
+                     const uint32_t *src, int32_t src_stride, int32_t src_width, int32_t src_height);
+    void mask(uint32_t key, uint32_t version, const rect &area, const uint8_t *mask,
+              int32_t mask_stride, int32_t src_x, int32_t src_y, uint32_t color);
+
+    /* appends the area drawn differently than in previous to damage */
+    void diff(const DisplayList &previous, std::vector<rect> &damage);
+
+    void optimize();
+
+    /* executes the optimized ops, clipped to region */
+    void replay(uint32_t *pixels, int32_t stride, const std::vector<rect> &region) const;
+
+    size_t size() const;
+    size_t batched_size() const;
+
+    /* the only op left after optimize(), nullptr when there are more */
+    const draw_op *sole_op() const;
+
+private:
+    struct key_index {
+        uint32_t key;
+        uint32_t index;
+    };
+
+    FrameArena arena;
+    ArenaVector<draw_op> ops;
+    ArenaVector<draw_op> batched;
+    ArenaVector<key_index> sorted;
+    ArenaVector<key_index> previous_sorted;
+
+    draw_op &append(uint8_t type, uint32_t key, const rect &area);
+    static void sort_keys(const ArenaVector<draw_op> &list, ArenaVector<key_index> &out);
+};
+
+#endif /* DISPLAY_LIST_H */
@@ -1,11 +1,24 @@
 #include "ExampleScene.h"
+#include "RenderThread.h"
+#include "ObjectPool.h"
+#include "Wallpaper.h"
+#include "Backdrop.h"
+#include "IconAtlas.h"
+#include "AssetLoader.h"
+#include "DiskCache.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <poll.h>
+#include <signal.h>
 #include <errno.h>
 #include <unistd.h>
+#include <time.h>
+#include <algorithm>
+#include <mutex>
 #include <string>
+#include <vector>
 
 static int
 set_cloexec_or_close(int fd)
@@ -102,20 +115,35 @@ int os_create_anonymous_file(off_t size)
     return fd;
 }
 
-static void buffer_release(void *data, struct wl_buffer *buffer) {
-	struct client_buffer *client_buffer = (struct client_buffer*) data;
-	client_buffer->busy = 0;
+/* surfaces and buffers are long-lived and recycled, keep them off the general heap */
+static ObjectPool<client_surface> surface_pool;
+static ObjectPool<client_buffer> buffer_pool;
+
+bool shm_format_supported(const struct client_display *display, uint32_t format) {
+    if (format == WL_SHM_FORMAT_XRGB8888 || format == WL_SHM_FORMAT_ARGB8888)
+        return true;
+    for (auto supported : display->shm_formats) {
+        if (supported == format)
+            return true;
+    }
+    return false;
 }
 
-static const struct wl_buffer_listener buffer_listener = {
-	buffer_release
-};
+int32_t shm_format_bytes(uint32_t format) {
+    return format == WL_SHM_FORMAT_RGB565 ? 2 : 4;
+}
 
-static struct client_buffer* create_client_buffer(struct wl_shm *shm, int32_t width, int32_t height) {
+struct client_buffer* create_client_buffer(struct client_display *display, int32_t width, int32_t height,
+                                           uint32_t format) {
     struct wl_shm_pool *pool;
-    int stride = width * 4; // 4 bytes per pixel
+    int stride = width * shm_format_bytes(format);
     int size = stride * height;
-    struct client_buffer *new_buffer = new client_buffer();
+    struct client_buffer *new_buffer = buffer_pool.create();
+    new_buffer->format = format;
+
+    if (display->slab_allocator &&
+        display->slab_allocator->allocate(new_buffer, width, height, stride, format))
+        return new_buffer;
 
     int fd = os_create_anonymous_file(size);
     if (fd < 0)
@@ -135,19 +163,57 @@ static struct client_buffer* create_client_buffer(struct wl_shm *shm, int32_t wi
     }
     fprintf(stderr, "Mapped memory to file: %p\n", new_buffer->data);
 
-    pool = wl_shm_create_pool(shm, fd, size);
+    pool = wl_shm_create_pool(display->shm, fd, size);
     fprintf(stderr, "Created pool\n");
     new_buffer->buffer = wl_shm_pool_create_buffer(pool, 0,
                                      width, height,
                                      stride,
-                                     WL_SHM_FORMAT_XRGB8888);
+                                     format);
     fprintf(stderr, "bufer created\n");
-    wl_buffer_add_listener(new_buffer->buffer, &buffer_listener, new_buffer);
     wl_shm_pool_destroy(pool);
-    
+    close(fd);
+
+    new_buffer->width = width;
+    new_buffer->height = height;
+    new_buffer->size = size;
     return new_buffer;
 }
 
+struct client_buffer* create_file_buffer(struct client_display *display, const struct file_image &image) {
+    struct client_buffer *new_buffer = buffer_pool.create();
+    size_t size = (size_t) image.offset + (size_t) image.stride * image.height;
+
+    struct wl_shm_pool *pool = wl_shm_create_pool(display->shm, image.fd, (int32_t) size);
+    new_buffer->buffer = wl_shm_pool_create_buffer(pool, (int32_t) image.offset,
+                                                   image.width, image.height, image.stride,
+                                                   WL_SHM_FORMAT_XRGB8888);
+    wl_shm_pool_destroy(pool);
+
+    new_buffer->data = (void *) image.pixels;
+    new_buffer->width = image.width;
+    new_buffer->height = image.height;
+    new_buffer->size = (size_t) image.stride * image.height;
+    new_buffer->format = WL_SHM_FORMAT_XRGB8888;
+    new_buffer->borrowed = true;
+    return new_buffer;
+}
+
+void destroy_client_buffer(struct client_buffer *buffer) {
+    if (buffer->allocator) {
+        buffer->allocator->release(buffer);
+        buffer_pool.destroy(buffer);
+        return;
+    }
+
+    if (buffer->buffer)
+        wl_buffer_destroy(buffer->buffer);
+
+    if (buffer->data && !buffer->borrowed)
+        munmap(buffer->data, buffer->size);
+
+    buffer_pool.destroy(buffer);
+}
+
 static void toplevel_configure(void *data, struct xdg_toplevel *xdg_toplevel, 
         int32_t width, int32_t height, struct wl_array *states) {
     struct client_surface *client_surface = (struct client_surface *)data;
@@ -169,22 +235,39 @@ static void toplevel_configure(void *data, struct xdg_toplevel *xdg_toplevel,
         }
     }
 
-    client_surface->width = width;
-    client_surface->height = height;
-    fprintf(stderr, "actual width: %d, height: %d\n", client_surface->width, client_surface->height);    
+    /* a wl_array of uint32_t states; wl_array_for_each does not compile as C++ */
+    bool suspended = false;
+    const uint32_t *state = (const uint32_t *) states->data;
+    for (size_t i = 0; i < states->size / sizeof(uint32_t); i++) {
+        if (state[i] == XDG_TOPLEVEL_STATE_SUSPENDED)
+            suspended = true;
+    }
+
+    /* only takes effect with the xdg_surface configure that ends the sequence */
+    client_surface->configured_width = width;
+    client_surface->configured_height = height;
+    client_surface->configured_suspended = suspended;
+    fprintf(stderr, "actual width: %d, height: %d\n", width, height);
 }
 
 static void toplevel_close(void *data, struct xdg_toplevel *toplevel) {
     fprintf(stderr, "toplevel closed.\n");
 }
 
+static void toplevel_configure_bounds(void *data, struct xdg_toplevel *toplevel, int32_t width, int32_t height) {
+}
+
+static void toplevel_wm_capabilities(void *data, struct xdg_toplevel *toplevel, struct wl_array *capabilities) {
+}
+
+/* the events of every version xdg_wm_base may be bound at must be handled */
 static xdg_toplevel_listener toplevel_listener = {
     .configure = toplevel_configure,
-    .close = toplevel_close
+    .close = toplevel_close,
+    .configure_bounds = toplevel_configure_bounds,
+    .wm_capabilities = toplevel_wm_capabilities,
 };
 
-void redraw(void *data, wl_callback *callback, uint32_t time);
-
 static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, uint32_t serial) {
     struct client_surface *client_surface = (struct client_surface *) data;
 
@@ -194,14 +277,8 @@ static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface, u
         fprintf(stderr, "Provided app xdg surface is null\n");
         return;
     }
-    xdg_surface_ack_configure(xdg_surface, serial);
-    fprintf(stderr, "Ack app configure for serial %d\n", serial);
-
-    client_surface->content.buffers[0] = create_client_buffer(client_surface->display->shm, client_surface->width, client_surface->height);
-    client_surface->content.buffers[1] = create_client_buffer(client_surface->display->shm, client_surface->width, client_surface->height);
-    fprintf(stderr, "Buffers created for surface %p\n", client_surface->surface);
-
-    redraw(client_surface, nullptr, 0);
+    /* dispatched on the surface thread, acked and drawn once the batch is through */
+    client_surface->renderer->configure_received(serial);
 }
 
 struct xdg_surface_listener xdg_surface_listener = {
@@ -209,22 +286,39 @@ struct xdg_surface_listener xdg_surface_listener = {
 };
 
 static client_surface* create_surface(client_display *display, 
-        std::function<void(void*, int32_t, int32_t)> draw, 
-        int32_t width, int32_t height) {
-    struct client_surface *new_surface = new client_surface();
+        std::function<void(void*, int32_t, int32_t)> draw, SceneGraph *scene,
+        int32_t width, int32_t height, uint32_t format,
+        const char *snapshot = nullptr, bool hold_snapshot = false) {
+    struct client_surface *new_surface = surface_pool.create();
     new_surface->draw = draw;
+    new_surface->scene = scene;
     new_surface->display = display;
     new_surface->width = width;
     new_surface->height = height;
-
-    new_surface->surface = wl_compositor_create_surface(display->compositor);
+    new_surface->configured_width = width;
+    new_surface->configured_height = height;
+    new_surface->format = format;
+    new_surface->renderer = new RenderThread(display, new_surface);
+
+    /*
+     * Objects are created through wrappers bound to the surface's own
+     * queue so no event can reach the default queue in between; the
+     * toplevel and frame callbacks inherit the queue of their parent.
+     */
+    struct wl_compositor *compositor_wrapper = (struct wl_compositor *) wl_proxy_create_wrapper(display->compositor);
+    wl_proxy_set_queue((struct wl_proxy *) compositor_wrapper, new_surface->renderer->queue());
+    new_surface->surface = wl_compositor_create_surface(compositor_wrapper);
+    wl_proxy_wrapper_destroy(compositor_wrapper);
     if (!new_surface->surface) {
         fprintf(stderr, "Can't create surface\n");
         return nullptr;
     }
     fprintf(stderr, "Created surface.\n");
-    
-    new_surface->xdg_surface = xdg_wm_base_get_xdg_surface(display->xdg_wm_base, new_surface->surface);
+
+    struct xdg_wm_base *wm_base_wrapper = (struct xdg_wm_base *) wl_proxy_create_wrapper(display->xdg_wm_base);
+    wl_proxy_set_queue((struct wl_proxy *) wm_base_wrapper, new_surface->renderer->queue());
+    new_surface->xdg_surface = xdg_wm_base_get_xdg_surface(wm_base_wrapper, new_surface->surface);
+    wl_proxy_wrapper_destroy(wm_base_wrapper);
     if (new_surface->xdg_surface == nullptr) {
         fprintf(stderr, "Can't create xdg_surface.\n");
         return nullptr;
@@ -244,39 +338,57 @@ static client_surface* create_surface(client_display *display,
 
     xdg_toplevel_set_app_id(new_surface->toplevel, "homescreen");
     fprintf(stderr, "Setted app id for xdg_toplevel\n");
+    if (snapshot)
+        new_surface->renderer->set_snapshot(snapshot, hold_snapshot);
+    new_surface->renderer->start();
     wl_surface_commit(new_surface->surface);
 
     return new_surface;
 }
 
-static const struct wl_callback_listener frame_listener = {
-	redraw
-};
-
-void redraw(void *data, wl_callback *callback, uint32_t time) {
-    struct client_surface *surface = (struct client_surface *)data;
-
-    client_buffer* next_buffer = surface->content.buffers[0];
-    if (next_buffer->busy) {
-        next_buffer = surface->content.buffers[1];
+/*
+ * A widget is a desynchronized subsurface with its own buffers and
+ * surface thread: redrawing it commits only the widget, the panel
+ * below keeps its buffer and is not repainted.
+ */
+static client_surface* create_widget(client_display *display, client_surface *parent,
+        std::function<void(void*, int32_t, int32_t)> draw, SceneGraph *scene,
+        int32_t x, int32_t y, int32_t width, int32_t height) {
+    struct client_surface *new_surface = surface_pool.create();
+    new_surface->draw = draw;
+    new_surface->scene = scene;
+    new_surface->display = display;
+    new_surface->width = width;
+    new_surface->height = height;
+    /* a scene draws into its panel's format, draw callbacks always paint XRGB8888 */
+    new_surface->format = scene ? parent->format : (uint32_t) WL_SHM_FORMAT_XRGB8888;
+    new_surface->renderer = new RenderThread(display, new_surface);
+
+    struct wl_compositor *compositor_wrapper = (struct wl_compositor *) wl_proxy_create_wrapper(display->compositor);
+    wl_proxy_set_queue((struct wl_proxy *) compositor_wrapper, new_surface->renderer->queue());
+    new_surface->surface = wl_compositor_create_surface(compositor_wrapper);
+    wl_proxy_wrapper_destroy(compositor_wrapper);
+    if (!new_surface->surface) {
+        fprintf(stderr, "Can't create widget surface\n");
+        return nullptr;
     }
 
-    next_buffer->busy = true;
-    surface->draw(next_buffer->data, surface->width, surface->height);
-
-    wl_surface_attach(surface->surface, next_buffer->buffer, 0, 0);
-    wl_surface_damage(surface->surface, 0, 0, surface->width, surface->height);
-    wl_surface_commit(surface->surface);
-
-    if (callback) {
-        wl_callback_destroy(callback);
+    new_surface->subsurface = wl_subcompositor_get_subsurface(display->subcompositor,
+                                                              new_surface->surface, parent->surface);
+    if (!new_surface->subsurface) {
+        fprintf(stderr, "Can't create widget subsurface\n");
+        return nullptr;
     }
+    /* takes effect with the parent's next commit */
+    wl_subsurface_set_position(new_surface->subsurface, x, y);
+    wl_subsurface_set_desync(new_surface->subsurface);
+    fprintf(stderr, "Created widget subsurface at %d,%d\n", x, y);
 
-    wl_callback *nextCallback = wl_surface_frame(surface->surface);
-	wl_callback_add_listener(nextCallback, &frame_listener, surface);
-	wl_surface_commit(surface->surface);
+    /* no configure comes for a subsurface, draw at the requested size */
+    new_surface->renderer->start();
+    new_surface->renderer->schedule(width, height);
 
-    surface->frameCalback = nextCallback;
+    return new_surface;
 }
 
 void xdg_wm_base_ping(void *data, struct xdg_wm_base *xdg_wm_base, uint32_t serial)
@@ -289,6 +401,81 @@ struct xdg_wm_base_listener xdg_wm_base_listener = {
     .ping = xdg_wm_base_ping
 };
 
+static void output_geometry(void *data, struct wl_output *output, int32_t x, int32_t y,
+        int32_t physical_width, int32_t physical_height, int32_t subpixel,
+        const char *make, const char *model, int32_t transform) {
+}
+
+static void output_mode(void *data, struct wl_output *output, uint32_t flags,
+        int32_t width, int32_t height, int32_t refresh) {
+    struct client_display *client_display = (struct client_display *) data;
+
+    if (!(flags & WL_OUTPUT_MODE_CURRENT))
+        return;
+    fprintf(stderr, "output mode %dx%d@%d\n", width, height, refresh);
+    client_display->output_width = width;
+    client_display->output_height = height;
+}
+
+static void output_done(void *data, struct wl_output *output) {
+}
+
+static void output_scale(void *data, struct wl_output *output, int32_t factor) {
+    struct client_display *client_display = (struct client_display *) data;
+
+    fprintf(stderr, "output scale %d\n", factor);
+    client_display->output_scale = factor > 0 ? factor : 1;
+}
+
+static const struct wl_output_listener output_listener = {
+    .geometry = output_geometry,
+    .mode = output_mode,
+    .done = output_done,
+    .scale = output_scale
+};
+
+static void desktop_application(void *data, struct agl_shell_desktop *agl_shell_desktop, const char *app_id) {
+    struct client_display *client_display = (struct client_display *) data;
+
+    for (auto &known : client_display->app_ids) {
+        if (known == app_id)
+            return;
+    }
+    fprintf(stderr, "application %s advertised\n", app_id);
+    client_display->app_ids.push_back(app_id);
+}
+
+/* fullscreen applications cover the background, see ExampleScene::update_occlusion() */
+static void desktop_state_app(void *data, struct agl_shell_desktop *agl_shell_desktop, const char *app_id,
+        const char *app_data, uint32_t state, uint32_t role) {
+    struct client_display *client_display = (struct client_display *) data;
+    std::vector<std::string> &fullscreen = client_display->fullscreen_apps;
+    std::vector<std::string>::iterator it = std::find(fullscreen.begin(), fullscreen.end(), app_id);
+
+    if (state == AGL_SHELL_DESKTOP_APP_STATE_ACTIVATED && role == AGL_SHELL_DESKTOP_APP_ROLE_FULLSCREEN) {
+        if (it == fullscreen.end())
+            fullscreen.push_back(app_id);
+    } else if (state == AGL_SHELL_DESKTOP_APP_STATE_DEACTIVATED && it != fullscreen.end()) {
+        fullscreen.erase(it);
+    }
+    fprintf(stderr, "application %s %s, %zu fullscreen\n", app_id,
+            state == AGL_SHELL_DESKTOP_APP_STATE_ACTIVATED ? "activated" : "deactivated", fullscreen.size());
+}
+
+static const struct agl_shell_desktop_listener desktop_listener = {
+    .application = desktop_application,
+    .state_app = desktop_state_app
+};
+
+static void shm_format(void *data, struct wl_shm *wl_shm, uint32_t format) {
+    struct client_display *client_display = (struct client_display *) data;
+    client_display->shm_formats.push_back(format);
+}
+
+static const struct wl_shm_listener shm_listener = {
+    .format = shm_format
+};
+
 void global_registry_handler(void *data, struct wl_registry *registry, uint32_t id,
                              const char *interface, uint32_t version) {
     fprintf(stderr, "Got a registry event for %s id %d\n", interface, id);
@@ -296,26 +483,47 @@ void global_registry_handler(void *data, struct wl_registry *registry, uint32_t
 
     if (strcmp(interface, wl_output_interface.name) == 0)
     {
-        client_display->output = (struct wl_output *)wl_registry_bind(client_display->registry, id, &wl_output_interface, 1);
+        /* version 2 brings the scale event */
+        uint32_t output_version = version < 2 ? version : 2;
+        client_display->output = (struct wl_output *)wl_registry_bind(client_display->registry, id, &wl_output_interface, output_version);
+        wl_output_add_listener(client_display->output, &output_listener, client_display);
     }
     else if (strcmp(interface, wl_compositor_interface.name) == 0)
     {
-        client_display->compositor = (struct wl_compositor *)wl_registry_bind(client_display->registry, id, &wl_compositor_interface, 1);
+        /* version 4 brings wl_surface.damage_buffer */
+        uint32_t compositor_version = version < 4 ? version : 4;
+        client_display->compositor = (struct wl_compositor *)wl_registry_bind(client_display->registry, id, &wl_compositor_interface, compositor_version);
     }
     else if (strcmp(interface, xdg_wm_base_interface.name) == 0)
     {
-        client_display->xdg_wm_base = (struct xdg_wm_base *)wl_registry_bind(client_display->registry, id, &xdg_wm_base_interface, 1);
+        /* as new as the generated code knows, version 6 brings the suspended state */
+        uint32_t wm_base_version = version < (uint32_t) xdg_wm_base_interface.version ?
+                                   version : (uint32_t) xdg_wm_base_interface.version;
+        client_display->xdg_wm_base = (struct xdg_wm_base *)wl_registry_bind(client_display->registry, id, &xdg_wm_base_interface, wm_base_version);
     }
     else if (strcmp(interface, wl_shm_interface.name) == 0)
     {
         client_display->shm = (struct wl_shm *) wl_registry_bind(client_display->registry, id,
                                &wl_shm_interface, 1);
+        /* the formats arrive before the startup roundtrip returns */
+        wl_shm_add_listener(client_display->shm, &shm_listener, client_display);
+    }
+    else if (strcmp(interface, wl_subcompositor_interface.name) == 0)
+    {
+        client_display->subcompositor = (struct wl_subcompositor *) wl_registry_bind(client_display->registry, id,
+                               &wl_subcompositor_interface, 1);
     }
     else if (strcmp(interface, agl_shell_interface.name) == 0)
     {
         client_display->agl_shell = (struct agl_shell *) wl_registry_bind(client_display->registry, id,
                                &agl_shell_interface, 1);
     }
+    else if (strcmp(interface, agl_shell_desktop_interface.name) == 0)
+    {
+        client_display->agl_shell_desktop = (struct agl_shell_desktop *) wl_registry_bind(client_display->registry, id,
+                               &agl_shell_desktop_interface, 1);
+        agl_shell_desktop_add_listener(client_display->agl_shell_desktop, &desktop_listener, client_display);
+    }
 }
 
 void global_registry_remover(void *data, struct wl_registry *registry, uint32_t id)
@@ -388,14 +596,23 @@ client_display* create_display() {
 }
 
 void destroy_surface(client_surface* surface) {
-    if (surface->frameCalback)
-		wl_callback_destroy(surface->frameCalback);
+    if (!surface)
+        return;
 
-	if (surface->content.buffers[0]->buffer)
-		wl_buffer_destroy(surface->content.buffers[0]->buffer);
+    if (surface->renderer)
+        surface->renderer->stop();
 
-	if (surface->content.buffers[1]->buffer)
-		wl_buffer_destroy(surface->content.buffers[1]->buffer);
+    struct wl_callback *frame_callback = surface->frameCalback.exchange(nullptr);
+    if (frame_callback)
+		wl_callback_destroy(frame_callback);
+
+    for (auto buffer : surface->content.buffers) {
+        if (buffer)
+            destroy_client_buffer(buffer);
+    }
+
+	if (surface->subsurface)
+		wl_subsurface_destroy(surface->subsurface);
 
 	if (surface->toplevel)
 		xdg_toplevel_destroy(surface->toplevel);
@@ -406,7 +623,10 @@ void destroy_surface(client_surface* surface) {
     if (surface->surface)
         wl_surface_destroy(surface->surface);
 
-    delete surface;
+    /* the queue goes last, after every proxy assigned to it */
+    delete surface->renderer;
+    delete surface->scene;
+    surface_pool.destroy(surface);
 }
 
 void destroy_display(client_display* display) {
@@ -419,6 +639,9 @@ void destroy_display(client_display* display) {
 	if (display->compositor)
 		wl_compositor_destroy(display->compositor);
 
+    if (display->subcompositor)
+        wl_subcompositor_destroy(display->subcompositor);
+
     if (display->registry)
         wl_registry_destroy(display->registry);
 	    
@@ -428,6 +651,9 @@ void destroy_display(client_display* display) {
     if (display->agl_shell)
         agl_shell_destroy(display->agl_shell);
 
+    if (display->agl_shell_desktop)
+        agl_shell_desktop_destroy(display->agl_shell_desktop);
+
     if (display->display) {
         wl_display_flush(display->display);
 	    wl_display_disconnect(display->display);
@@ -436,12 +662,200 @@ void destroy_display(client_display* display) {
 	delete display;
 }
 
-void top_draw(void* data, int32_t width, int32_t height) {
-    memset(data, 0xff, width * height * 4);
+#define PANEL_COLOR 0xffffffff
+#define BACKGROUND_COLOR 0xffafafaf
+#define CLOCK_COLOR 0xff202020
+
+/* indexed by ExampleScene::theme, day first */
+static const uint32_t panel_colors[] = { PANEL_COLOR, 0xff303030 };
+static const uint32_t background_colors[] = { BACKGROUND_COLOR, 0xff101010 };
+static const uint32_t clock_colors[] = { CLOCK_COLOR, 0xffe0e0e0 };
+
+static SceneGraph* create_panel_scene() {
+    return new SceneGraph(PANEL_COLOR);
+}
+
+static SceneGraph* create_background_scene() {
+    return new SceneGraph(BACKGROUND_COLOR);
+}
+
+#define CLOCK_TEXT_SIZE 22
+#define CLOCK_X 70
+#define CLOCK_Y 30
+#define CLOCK_WIDTH 120
+#define CLOCK_HEIGHT 40
+
+#define LOAD_METER_X 10
+#define LOAD_METER_Y 30
+#define LOAD_METER_WIDTH 52
+#define LOAD_METER_HEIGHT 40
+/* pixels per sample, the meter shows the last 26 seconds */
+#define LOAD_METER_BAR 2
+#define LOAD_METER_PERIOD_MS 1000
+#define LOAD_METER_SAMPLES (LOAD_METER_WIDTH / LOAD_METER_BAR)
+
+static const uint32_t load_meter_colors[] = { 0xff3a7bd5, 0xff8ab4f8 };
+
+/*
+ * Sampled by the dispatch thread, painted by the widget's draw callback
+ * on its surface thread. A new sample overwrites the oldest bar in
+ * place instead of scrolling, so consecutive frames differ in two bars
+ * and the legacy damage tracking commits only those.
+ */
+struct load_meter {
+    std::mutex mutex;
+    /* busy percentage per bar */
+    uint8_t samples[LOAD_METER_SAMPLES] = {};
+    size_t next = 0;
+    int theme = 0;
+    /* /proc/stat counters at the last sample */
+    uint64_t busy = 0;
+    uint64_t total = 0;
+    struct timespec sampled;
+};
+
+static bool read_cpu_times(uint64_t &busy, uint64_t &total) {
+    FILE *stat_file = fopen("/proc/stat", "re");
+    if (!stat_file)
+        return false;
+
+    unsigned long long times[8] = {};
+    int count = fscanf(stat_file, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+                       &times[0], &times[1], &times[2], &times[3],
+                       &times[4], &times[5], &times[6], &times[7]);
+    fclose(stat_file);
+    if (count < 4)
+        return false;
+
+    total = 0;
+    for (auto time : times)
+        total += time;
+    /* idle and iowait */
+    busy = total - times[3] - times[4];
+    return true;
 }
 
-void bg_draw(void* data, int32_t width, int32_t height) {
-    memset(data, 0xaf, width * height * 4);
+static void draw_load_meter(load_meter *meter, void *data, int32_t width, int32_t height) {
+    std::lock_guard<std::mutex> lock(meter->mutex);
+    uint32_t background = panel_colors[meter->theme];
+    uint32_t bar = load_meter_colors[meter->theme];
+
+    for (int32_t y = 0; y < height; y++) {
+        uint32_t *row = (uint32_t *) data + (size_t) y * width;
+        for (int32_t x = 0; x < width; x++) {
+            size_t i = (size_t) (x / LOAD_METER_BAR);
+            /* the bar about to be overwritten is left out, it marks the newest sample */
+            bool lit = i < LOAD_METER_SAMPLES && i != meter->next &&
+                       (height - y) * 100 <= meter->samples[i] * height;
+            row[x] = lit ? bar : background;
+        }
+    }
+}
+
+void ExampleScene::create_widgets(client_surface *panel) {
+    if (!this->display->subcompositor) {
+        fprintf(stderr, "wl_subcompositor not available, panel has no widgets.\n");
+        return;
+    }
+
+    SceneGraph *clock_scene = new SceneGraph(PANEL_COLOR);
+    this->clock_text = clock_scene->add_text(SCENE_ROOT, 8, 8, "", CLOCK_TEXT_SIZE, clock_colors[this->theme]);
+    clock_scene->set_text_renderer(this->text_renderer);
+    this->clock = create_widget(this->display, panel, nullptr, clock_scene,
+                                CLOCK_X, CLOCK_Y, CLOCK_WIDTH, CLOCK_HEIGHT);
+    if (!this->clock) {
+        fprintf(stderr, "Unable to create clock widget.\n");
+        return;
+    }
+    this->widgets.push_back(this->clock);
+    update_clock();
+
+    load_meter *meter = new load_meter();
+    meter->theme = this->theme;
+    read_cpu_times(meter->busy, meter->total);
+    clock_gettime(CLOCK_MONOTONIC, &meter->sampled);
+    this->load_widget = create_widget(this->display, panel,
+                                      [meter](void *data, int32_t width, int32_t height) {
+                                          draw_load_meter(meter, data, width, height);
+                                      },
+                                      nullptr, LOAD_METER_X, LOAD_METER_Y, LOAD_METER_WIDTH, LOAD_METER_HEIGHT);
+    if (!this->load_widget) {
+        fprintf(stderr, "Unable to create load meter widget.\n");
+        delete meter;
+        return;
+    }
+    this->meter = meter;
+    this->widgets.push_back(this->load_widget);
+}
+
+/* polled from the dispatch loop, touches the clock only when the minute changes */
+void ExampleScene::update_clock() {
+    if (!this->clock)
+        return;
+
+    char value[sizeof(this->clock_value)];
+    time_t now = time(nullptr);
+    struct tm local;
+    localtime_r(&now, &local);
+    strftime(value, sizeof(value), "%H:%M", &local);
+    if (strcmp(value, this->clock_value) == 0)
+        return;
+
+    strcpy(this->clock_value, value);
+    this->clock->scene->set_text(this->clock_text, value);
+    this->clock->renderer->invalidate();
+}
+
+/* polled from the dispatch loop, samples the CPU load once per period */
+void ExampleScene::update_load_meter() {
+    if (!this->meter)
+        return;
+
+    load_meter *meter = this->meter;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t elapsed = (int64_t) (now.tv_sec - meter->sampled.tv_sec) * 1000 +
+                      (now.tv_nsec - meter->sampled.tv_nsec) / 1000000;
+    if (elapsed < LOAD_METER_PERIOD_MS)
+        return;
+    meter->sampled = now;
+
+    uint64_t busy, total;
+    if (!read_cpu_times(busy, total) || total <= meter->total)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(meter->mutex);
+        meter->samples[meter->next] = (uint8_t) ((busy - meter->busy) * 100 / (total - meter->total));
+        meter->next = (meter->next + 1) % LOAD_METER_SAMPLES;
+    }
+    meter->busy = busy;
+    meter->total = total;
+    this->load_widget->renderer->invalidate();
+}
+
+/*
+ * Flat panels lose little to RGB565 and halve their shm memory and
+ * upload bandwidth; photos (the background) stay XRGB8888.
+ * HOMESCREEN_PANEL_FORMAT=xrgb8888 keeps panels at full depth.
+ */
+static uint32_t panel_format(const client_display *display) {
+    const char *value = getenv("HOMESCREEN_PANEL_FORMAT");
+    if (value && strcmp(value, "xrgb8888") == 0)
+        return WL_SHM_FORMAT_XRGB8888;
+    if (value && strcmp(value, "rgb565") != 0)
+        fprintf(stderr, "unknown HOMESCREEN_PANEL_FORMAT '%s', using rgb565\n", value);
+
+    if (!shm_format_supported(display, WL_SHM_FORMAT_RGB565)) {
+        fprintf(stderr, "compositor has no RGB565 shm buffers, panels use XRGB8888\n");
+        return WL_SHM_FORMAT_XRGB8888;
+    }
+    return WL_SHM_FORMAT_RGB565;
+}
+
+/* HOMESCREEN_BOOT_SNAPSHOT=0 starts every surface from its scene */
+static bool boot_snapshots_enabled() {
+    const char *value = getenv("HOMESCREEN_BOOT_SNAPSHOT");
+    return !value || strcmp(value, "0") != 0;
 }
 
 int ExampleScene::init() {
@@ -450,22 +864,51 @@ int ExampleScene::init() {
         fprintf(stderr, "Unable to initialize display.\n");
         return 1;
     }
+    this->display->scheduler = new TaskScheduler(TaskScheduler::config_from_env());
+    this->loader = new AssetLoader(this->display->scheduler);
+    this->display->slab_allocator = new ShmSlabAllocator(this->display->shm);
+
+    /* widgets come up without text when the font does not load */
+    this->text_renderer = new TextRenderer();
+    this->text_renderer->load_font(TextRenderer::font_path());
 
-    client_surface* top_surface = create_surface(this->display, top_draw, 200, 100);
+    bool snapshots = boot_snapshots_enabled();
+    client_surface* top_surface = create_surface(this->display, nullptr, create_panel_scene(), 200, 100,
+                                                 panel_format(this->display), snapshots ? "panel" : nullptr);
     if (!top_surface) {
         fprintf(stderr, "Unable to create top surface.\n");
         destroy_surface(top_surface);
         return 2;
     }
     this->surfaces.push_back(top_surface);
-
-    client_surface* background = create_surface(this->display, bg_draw, 1920, 1080);
+    this->panel = top_surface;
+    create_widgets(top_surface);
+
+    int32_t background_width = this->display->output_width > 0 ? this->display->output_width : 1920;
+    int32_t background_height = this->display->output_height > 0 ? this->display->output_height : 1080;
+    const char *wallpaper_path = getenv("HOMESCREEN_WALLPAPER");
+    const char *backdrop = wallpaper_path ? nullptr : getenv("HOMESCREEN_BACKGROUND");
+    /* the snapshot most likely shows the image, keep it up until the image is ready */
+    client_surface* background = create_surface(this->display, nullptr, create_background_scene(),
+                                                background_width, background_height, WL_SHM_FORMAT_XRGB8888,
+                                                snapshots ? "background" : nullptr,
+                                                wallpaper_path != nullptr || backdrop != nullptr);
     if (!background) {
         fprintf(stderr, "Unable to initialize background.\n");
         destroy_surface(background);
         return 3;
     }
     this->surfaces.push_back(background);
+    this->background = background;
+
+    if (wallpaper_path)
+        load_wallpaper(wallpaper_path, background_width, background_height);
+    else if (backdrop)
+        load_backdrops(backdrop, background_width, background_height);
+
+    /* cache the day frames as well, for switching back */
+    top_surface->renderer->set_state(panel_state_key());
+    background->renderer->set_state(background_state_key());
 
     agl_shell_set_panel(this->display->agl_shell, top_surface->surface, this->display->output, AGL_SHELL_EDGE_TOP);
     agl_shell_set_background(this->display->agl_shell, background->surface, this->display->output);
@@ -474,6 +917,254 @@ int ExampleScene::init() {
     return 0;
 }
 
+/*
+ * The background shows its color until the image is ready: a cache miss
+ * decodes and scales on a worker, a hit only maps the converted file.
+ */
+void ExampleScene::load_wallpaper(const char *path, int32_t width, int32_t height) {
+    this->wallpaper = new Wallpaper();
+    std::string source(path);
+    Wallpaper *wallpaper = this->wallpaper;
+    TaskScheduler *scheduler = this->display->scheduler;
+
+    this->loader->request("wallpaper:" + source, ASSET_PRIORITY_VISIBLE,
+        [wallpaper, source, width, height, scheduler]() {
+            return wallpaper->load(source.c_str(), width, height, scheduler);
+        },
+        [this](bool ok) {
+            if (ok)
+                show_wallpaper();
+            this->background->renderer->release_snapshot();
+        });
+}
+
+/* completion on the dispatch thread, the scene is changed from this thread only */
+void ExampleScene::show_wallpaper() {
+    this->background->renderer->begin_state_change();
+    /* registered first, so the first frame showing it already goes zero-copy */
+    this->background->renderer->set_file_image(this->wallpaper->cached_image().file());
+    this->background->scene->add_image(SCENE_ROOT, 0, 0, this->wallpaper->cached_image().image());
+
+    /* frames cached before show the plain color, they must not come back */
+    this->background_generation++;
+    this->background->renderer->set_state(background_state_key());
+}
+
+/*
+ * Both themes' backgrounds are generated, the one not shown only as a
+ * prefetch, so switching themes later finds its file ready.
+ */
+void ExampleScene::load_backdrops(const char *text, int32_t width, int32_t height) {
+    TaskScheduler *scheduler = this->display->scheduler;
+
+    for (int32_t theme = 0; theme < 2; theme++) {
+        backdrop_spec spec;
+        if (!Backdrop::parse(text, theme, spec)) {
+            this->background->renderer->release_snapshot();
+            return;
+        }
+        this->backdrops[theme] = new Backdrop();
+        Backdrop *backdrop = this->backdrops[theme];
+
+        char key[32];
+        snprintf(key, sizeof(key), "backdrop:%d", theme);
+        this->loader->request(key, theme == this->theme ? ASSET_PRIORITY_VISIBLE : ASSET_PRIORITY_PREFETCH,
+            [backdrop, spec, width, height, scheduler]() {
+                return backdrop->load(spec, width, height, scheduler);
+            },
+            [this, theme](bool ok) {
+                /* frames of either theme cached so far lack this image */
+                if (ok)
+                    this->background_generation++;
+                if (theme != this->theme)
+                    return;
+                if (ok) {
+                    this->background->renderer->begin_state_change();
+                    show_backdrop();
+                    this->background->renderer->set_state(background_state_key());
+                }
+                this->background->renderer->release_snapshot();
+            });
+    }
+}
+
+/*
+ * The current theme's background, if it is generated by now. Callers
+ * bracket it with a state change.
+ */
+void ExampleScene::show_backdrop() {
+    Backdrop *backdrop = this->backdrops[this->theme];
+    if (!backdrop || !backdrop->cached_image().loaded()) {
+        /* the other theme's image must not stay, its completion shows this one */
+        if (this->backdrop_node)
+            this->background->scene->set_visible(this->backdrop_node, false);
+        return;
+    }
+
+    this->background->renderer->set_file_image(backdrop->cached_image().file());
+    if (this->backdrop_node) {
+        this->background->scene->set_image(this->backdrop_node, backdrop->cached_image().image());
+        this->background->scene->set_visible(this->backdrop_node, true);
+    } else {
+        this->backdrop_node = this->background->scene->add_image(SCENE_ROOT, 0, 0, backdrop->cached_image().image());
+    }
+}
+
+/*
+ * Polled from the dispatch loop. While a fullscreen application is up
+ * the background cannot be seen: its surface stops drawing and gives
+ * back the buffers it does not show. The panel stays, fullscreen
+ * applications leave it in place.
+ */
+void ExampleScene::update_occlusion() {
+    bool occluded = !this->display->fullscreen_apps.empty();
+    if (occluded == this->background_occluded || !this->background)
+        return;
+
+    this->background_occluded = occluded;
+    this->background->renderer->set_suspended(occluded);
+}
+
+#define LAUNCHER_X 210
+#define LAUNCHER_Y 26
+#define LAUNCHER_SPACING 12
+
+/* the panel depends on the theme and on the launcher icons */
+uint64_t ExampleScene::panel_state_key() const {
+    return (((uint64_t) this->launcher_generation << 1) | (uint64_t) this->theme) + 1;
+}
+
+/* the background on the theme and on the wallpaper or backdrops loaded so far */
+uint64_t ExampleScene::background_state_key() const {
+    return (((uint64_t) this->background_generation << 1) | (uint64_t) this->theme) + 1;
+}
+
+/*
+ * Polled from the dispatch loop. Whenever the compositor advertised more
+ * applications, their icons are packed again by the loader; the panel
+ * keeps showing the previous atlas until the new one is ready.
+ */
+void ExampleScene::update_launcher() {
+    if (!this->panel)
+        return;
+
+    /* an atlas is freed once the panel painted a frame without it */
+    if (!this->retired_icons.empty()) {
+        uint64_t updates = this->panel->scene->update_count();
+        for (auto it = this->retired_icons.begin(); it != this->retired_icons.end();) {
+            if (updates > it->second) {
+                delete it->first;
+                it = this->retired_icons.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    /* the list, not just its length: an app may replace another */
+    std::string joined;
+    for (auto &id : this->display->app_ids)
+        joined += id + "|";
+    uint64_t hash = cache_hash(joined.c_str());
+    if (this->icons_loading || this->display->app_ids.empty() || hash == this->icons_requested)
+        return;
+
+    this->icons_requested = hash;
+    IconAtlas *atlas = new IconAtlas();
+    this->icons_loading = atlas;
+    std::vector<std::string> app_ids = this->display->app_ids;
+    int32_t scale = this->display->output_scale;
+    TaskScheduler *scheduler = this->display->scheduler;
+    char key[32];
+    snprintf(key, sizeof(key), "icons:%016llx", (unsigned long long) hash);
+
+    /* an icon that decodes slowly holds up the launcher, never the first frame */
+    this->loader->request(key, ASSET_PRIORITY_SOON,
+        [atlas, app_ids, scale, scheduler]() {
+            return atlas->load(app_ids, scale, scheduler);
+        },
+        [this, atlas](bool ok) {
+            this->icons_loading = nullptr;
+            if (!ok) {
+                delete atlas;
+                return;
+            }
+            IconAtlas *replaced = this->icons;
+            this->icons = atlas;
+            show_launcher();
+            if (replaced)
+                this->retired_icons.push_back(std::make_pair(replaced, this->panel->scene->update_count()));
+        });
+}
+
+/* one image node per icon, all blitting out of the same atlas */
+void ExampleScene::show_launcher() {
+    SceneGraph *scene = this->panel->scene;
+
+    this->panel->renderer->begin_state_change();
+
+    size_t shown = 0;
+    for (size_t i = 0; i < this->icons->icon_count(); i++) {
+        scene_image image;
+        if (!this->icons->find(i, ICON_SIZE, image))
+            continue;
+
+        float x = LAUNCHER_X + (float) shown * (ICON_SIZE + LAUNCHER_SPACING);
+        if (shown < this->launcher_icons.size()) {
+            scene_node_id node = this->launcher_icons[shown];
+            scene->set_image(node, image);
+            scene->set_position(node, x, LAUNCHER_Y);
+            scene->set_visible(node, true);
+        } else {
+            this->launcher_icons.push_back(scene->add_image(SCENE_ROOT, x, LAUNCHER_Y, image));
+        }
+        shown++;
+    }
+    for (size_t i = shown; i < this->launcher_icons.size(); i++)
+        scene->set_visible(this->launcher_icons[i], false);
+
+    fprintf(stderr, "Launcher shows %zu icons\n", shown);
+    /* a new state, so no cached frame with the old icons comes back */
+    this->launcher_generation++;
+    this->panel->renderer->set_state(panel_state_key());
+}
+
+void ExampleScene::toggle_theme() {
+    if (!this->panel || !this->background)
+        return;
+
+    this->theme ^= 1;
+    fprintf(stderr, "Switching to the %s theme\n", this->theme ? "night" : "day");
+
+    this->panel->renderer->begin_state_change();
+    this->background->renderer->begin_state_change();
+    this->panel->scene->set_clear_color(panel_colors[this->theme]);
+    this->background->scene->set_clear_color(background_colors[this->theme]);
+    show_backdrop();
+
+    this->panel->renderer->set_state(panel_state_key());
+    this->background->renderer->set_state(background_state_key());
+
+    /* the clock shows the time as well, it is repainted */
+    if (this->clock) {
+        this->clock->scene->set_clear_color(panel_colors[this->theme]);
+        this->clock->scene->set_color(this->clock_text, clock_colors[this->theme]);
+        this->clock->renderer->invalidate();
+    }
+    if (this->meter) {
+        std::lock_guard<std::mutex> lock(this->meter->mutex);
+        this->meter->theme = this->theme;
+    }
+    if (this->load_widget)
+        this->load_widget->renderer->invalidate();
+}
+
+static volatile sig_atomic_t theme_switch_requested = 0;
+
+void ExampleScene::request_theme_switch() {
+    theme_switch_requested = 1;
+}
+
 ExampleScene::ExampleScene()
 {
     this->display = new client_display();
@@ -483,20 +1174,176 @@ ExampleScene::ExampleScene()
     }
 }
 
+/*
+ * Longest the dispatch thread may block before it re-checks the running
+ * flag. Draw callbacks run on the surface threads, so xdg_wm_base pings
+ * are never queued behind a frame.
+ */
+#define DISPATCH_DEADLINE_MS 100
+
+/* quiet time before the idle work: slab compaction, boot snapshots, memory report */
+#define IDLE_WORK_AFTER_MS 5000
+
+static int64_t monotonic_ms()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
 void ExampleScene::loop(std::function<bool()> stillRunning)
 {
-    while (stillRunning() && wl_display_dispatch(this->display->display) != -1)
+    struct wl_display *wl_display = this->display->display;
+    std::vector<struct pollfd> fds(1);
+    std::vector<RenderThread *> renderers;
+
+    fds[0].fd = wl_display_get_fd(wl_display);
+    fds[0].events = POLLIN;
+    for (auto list : { &this->surfaces, &this->widgets }) {
+        for (auto surface : *list) {
+            struct pollfd fd;
+            fd.fd = surface->renderer->completion_fd();
+            fd.events = POLLIN;
+            fds.push_back(fd);
+            renderers.push_back(surface->renderer);
+        }
+    }
+    struct pollfd loader_fd;
+    loader_fd.fd = this->loader->fd();
+    loader_fd.events = POLLIN;
+    fds.push_back(loader_fd);
+
+    /*
+     * Activity is a frame of real content or a finished load. Display
+     * events do not count, they follow our own commits, and neither do
+     * the load meter's frames, it ticks forever.
+     */
+    int64_t last_activity = monotonic_ms();
+    bool idle_work_done = false;
+
+    while (stillRunning())
     {
-        /* This space deliberately left blank */
+        while (wl_display_prepare_read(wl_display) != 0)
+            wl_display_dispatch_pending(wl_display);
+        wl_display_flush(wl_display);
+
+        int ready = poll(fds.data(), fds.size(), DISPATCH_DEADLINE_MS);
+        if (ready < 0 && errno != EINTR) {
+            wl_display_cancel_read(wl_display);
+            fprintf(stderr, "poll failed: %m\n");
+            break;
+        }
+
+        /* a few quiet seconds, nothing is animating */
+        if (!idle_work_done && monotonic_ms() - last_activity >= IDLE_WORK_AFTER_MS) {
+            idle_work_done = true;
+            if (this->display->slab_allocator)
+                this->display->slab_allocator->compact();
+            /* settled content is what the next boot shows first */
+            for (auto surface : this->surfaces)
+                surface->renderer->request_snapshot();
+            for (auto list : { &this->surfaces, &this->widgets }) {
+                for (auto surface : *list)
+                    surface->renderer->dump_memory(stderr);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            if (wl_display_read_events(wl_display) == -1)
+                break;
+        } else {
+            wl_display_cancel_read(wl_display);
+        }
+
+        if (wl_display_dispatch_pending(wl_display) == -1)
+            break;
+
+        bool active = false;
+        for (size_t i = 0; i < renderers.size(); i++) {
+            if (fds[i + 1].revents & POLLIN) {
+                renderers[i]->present_completed();
+                if (!this->load_widget || renderers[i] != this->load_widget->renderer)
+                    active = true;
+            }
+        }
+
+        if (fds.back().revents & POLLIN) {
+            this->loader->dispatch();
+            active = true;
+        }
+
+        if (theme_switch_requested) {
+            theme_switch_requested = 0;
+            toggle_theme();
+            active = true;
+        }
+
+        if (active) {
+            last_activity = monotonic_ms();
+            idle_work_done = false;
+        }
+
+        update_clock();
+        update_load_meter();
+        update_launcher();
+        update_occlusion();
     }
 }
 
 ExampleScene::~ExampleScene()
 {
+    /* stop every surface thread before any proxy goes away */
+    for (auto widget : this->widgets) {
+        widget->renderer->stop();
+    }
+    for (auto surface : this->surfaces) {
+        surface->renderer->stop();
+    }
+
+    /* widgets before the panels they are attached to */
+    for (auto widget : this->widgets) {
+        destroy_surface(widget);
+    }
     for (auto surface : this->surfaces) {
         destroy_surface(surface);
     }
     fprintf(stderr, "Cleaned up all the surfaces.\n");
+    /* the load meter's draw callback ran on a widget thread, gone now */
+    delete this->meter;
+
+    /* render threads shape text, they are all gone now */
+    if (this->text_renderer) {
+        this->text_renderer->dump_stats(stderr);
+        delete this->text_renderer;
+        this->text_renderer = nullptr;
+    }
+
+    if (this->display && this->display->slab_allocator) {
+        this->display->slab_allocator->dump_stats(stderr);
+        delete this->display->slab_allocator;
+        this->display->slab_allocator = nullptr;
+    }
+
+    if (this->loader) {
+        this->loader->dump_stats(stderr);
+        delete this->loader;
+        this->loader = nullptr;
+    }
+
+    if (this->display && this->display->scheduler) {
+        this->display->scheduler->wait_idle();
+        this->display->scheduler->dump_stats(stderr);
+        delete this->display->scheduler;
+        this->display->scheduler = nullptr;
+    }
+    /* after the scheduler, a load may have been running */
+    delete this->wallpaper;
+    delete this->backdrops[0];
+    delete this->backdrops[1];
+    delete this->icons_loading;
+    delete this->icons;
+    for (auto &retired : this->retired_icons)
+        delete retired.first;
 
     destroy_display(this->display);
     fprintf(stderr, "Cleaned up display related objects.\n");
@@ -5,9 +5,18 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <list>
+#include <atomic>
 #include <functional>
+#include <string>
+#include <utility>
+#include <vector>
 #include "wayland-agl-shell-client-protocol.h"
+#include "wayland-agl-shell-desktop-client-protocol.h"
 #include "xdg-shell-client-protocol.h"
+#include "TaskScheduler.h"
+#include "Geometry.h"
+#include "SceneGraph.h"
+#include "ShmSlab.h"
 
 struct client_display {
     struct wl_display* display = nullptr;
@@ -17,16 +26,53 @@ struct client_display {
     struct wl_shm *shm;
     struct xdg_wm_base* xdg_wm_base;
     struct agl_shell *agl_shell; 
+    struct wl_subcompositor* subcompositor = nullptr;
+    struct agl_shell_desktop* agl_shell_desktop = nullptr;
+    /* current mode of the output, 0 until the compositor sent it */
+    int32_t output_width = 0;
+    int32_t output_height = 0;
+    int32_t output_scale = 1;
+    /* wl_shm formats the compositor announced */
+    std::vector<uint32_t> shm_formats;
+    /* applications the compositor advertised, in order of arrival */
+    std::vector<std::string> app_ids;
+    /* applications activated in the fullscreen role and not deactivated since */
+    std::vector<std::string> fullscreen_apps;
+
+    /* shared by the render, asset decode and startup paths */
+    TaskScheduler *scheduler = nullptr;
+    /* backs buffers small enough to share a pool with others */
+    ShmSlabAllocator *slab_allocator = nullptr;
 };
 
 struct client_buffer {
     wl_buffer *buffer;
     void *data;
     bool busy;
+    int32_t width;
+    int32_t height;
+    size_t size;
+    /* wl_shm format, rows are width times its pixel size */
+    uint32_t format;
+
+    /* set when the buffer lives in a shared slab rather than its own pool */
+    ShmSlabAllocator *allocator;
+    struct shm_slab *slab;
+    int32_t slot;
+    /* data is a mapping owned by someone else, e.g. a cache file */
+    bool borrowed;
+
+    /* area changed by frames drawn into other buffers since this one was painted */
+    std::vector<rect> pending_damage;
 };
 
+/* deepest swapchain a surface may use, see HOMESCREEN_SWAPCHAIN_BUFFERS */
+#define MAX_SWAPCHAIN_BUFFERS 4
+
 struct client_content {
-    client_buffer* buffers[2];    
+    /* the first buffer_count entries are in use, the rest stay null */
+    client_buffer* buffers[MAX_SWAPCHAIN_BUFFERS];
+    int32_t buffer_count;
 };
     
 struct client_surface {
@@ -34,25 +80,112 @@ struct client_surface {
     struct wl_surface* surface;
     struct xdg_surface* xdg_surface;
     struct xdg_toplevel* toplevel;
-    struct wl_callback* frameCalback;
+    /* widgets have no xdg role, they are desynchronized subsurfaces of a panel */
+    struct wl_subsurface* subsurface;
+    std::atomic<struct wl_callback*> frameCalback;
     int32_t width;
     int32_t height;
+    /* size from the latest toplevel configure, applied when its sequence ends */
+    int32_t configured_width;
+    int32_t configured_height;
+    bool configured_suspended;
 
     client_content content;
     std::function<void(void*, int32_t, int32_t)> draw;
+    /* when set, replaces draw and limits repaints to what changed */
+    SceneGraph* scene;
+
+    /* surface thread state, see RenderThread */
+    class RenderThread* renderer;
+    int32_t buffer_width;
+    int32_t buffer_height;
+    /* wl_shm format of the scene's buffers, which render in XRGB8888 and convert */
+    uint32_t format;
+    bool frame_pending;
+    std::atomic<int> in_flight;
 };
 
+/* XRGB8888 pixels stored in a file at a page-aligned offset, also mapped at pixels */
+struct file_image {
+    const uint32_t *pixels;
+    int fd;
+    off_t offset;
+    int32_t width;
+    int32_t height;
+    int32_t stride;
+};
+
+int os_create_anonymous_file(off_t size);
+struct client_buffer* create_client_buffer(struct client_display *display, int32_t width, int32_t height,
+                                           uint32_t format = WL_SHM_FORMAT_XRGB8888);
+/* XRGB8888 and ARGB8888 are always there, others only when announced */
+bool shm_format_supported(const struct client_display *display, uint32_t format);
+int32_t shm_format_bytes(uint32_t format);
+/* a buffer the compositor reads straight from the image's file */
+struct client_buffer* create_file_buffer(struct client_display *display, const struct file_image &image);
+void destroy_client_buffer(struct client_buffer *buffer);
+
 class ExampleScene
 {
 private:
     struct client_display *display;
     std::list<struct client_surface *> surfaces;
+    std::list<struct client_surface *> widgets;
+
+    struct client_surface *panel = nullptr;
+    struct client_surface *background = nullptr;
+    bool background_occluded = false;
+    /* bumped whenever the background's image changes */
+    uint32_t background_generation = 0;
+    int theme = 0;
+
+    struct client_surface *clock = nullptr;
+    scene_node_id clock_text = 0;
+    char clock_value[8] = "";
+    TextRenderer *text_renderer = nullptr;
+
+    /* CPU load, painted by a draw callback rather than a scene */
+    struct client_surface *load_widget = nullptr;
+    struct load_meter *meter = nullptr;
+
+    /* runs decodes off this thread, completions come back through the loop */
+    class AssetLoader *loader = nullptr;
+    class Wallpaper *wallpaper = nullptr;
+    /* procedural background per theme, when there is no wallpaper */
+    class Backdrop *backdrops[2] = {};
+    scene_node_id backdrop_node = 0;
+
+    /* launcher icons on the panel, one node per icon */
+    class IconAtlas *icons = nullptr;
+    class IconAtlas *icons_loading = nullptr;
+    /* replaced atlases, with the panel's update count after the switch */
+    std::list<std::pair<class IconAtlas *, uint64_t>> retired_icons;
+    /* hash of the app ids the last atlas was requested for */
+    uint64_t icons_requested = 0;
+    std::vector<scene_node_id> launcher_icons;
+    uint32_t launcher_generation = 0;
 public:
     ExampleScene();
     void loop(std::function<bool()> stillRunning);
+    /* switches between the day and night colors */
+    void toggle_theme();
+    /* async-signal-safe, the dispatch loop toggles the theme on its next pass */
+    static void request_theme_switch();
     ~ExampleScene();
 private:
     int init();
+    void create_widgets(struct client_surface *panel);
+    void update_clock();
+    void update_load_meter();
+    void load_wallpaper(const char *path, int32_t width, int32_t height);
+    void show_wallpaper();
+    void load_backdrops(const char *text, int32_t width, int32_t height);
+    void show_backdrop();
+    void update_launcher();
+    void update_occlusion();
+    void show_launcher();
+    uint64_t panel_state_key() const;
+    uint64_t background_state_key() const;
 };
 
 #endif /* WAYLAND_DISPLAY_H */
\ No newline at end of file
@@ -0,0 +1,79 @@
+#include "FrameArena.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static uint8_t *allocate_chunk(size_t size)
+{
+    uint8_t *data = (uint8_t *) malloc(size);
+    if (!data) {
+        fprintf(stderr, "frame arena: allocating %zu B failed\n", size);
+        exit(1);
+    }
+    return data;
+}
+
+FrameArena::FrameArena(size_t initial_size)
+{
+    chunk first = { allocate_chunk(initial_size), initial_size };
+    this->chunks.reserve(8);
+    this->chunks.push_back(first);
+    this->offset = 0;
+    this->total_used = 0;
+    this->peak = 0;
+}
+
+FrameArena::~FrameArena()
+{
+    for (auto &c : this->chunks)
+        free(c.data);
+}
+
+void *FrameArena::allocate(size_t size, size_t align)
+{
+    chunk *current = &this->chunks.back();
+    size_t start = (this->offset + align - 1) & ~(align - 1);
+
+    if (start + size > current->size) {
+        size_t chunk_size = current->size * 2;
+        while (chunk_size < size + align)
+            chunk_size *= 2;
+
+        chunk next = { allocate_chunk(chunk_size), chunk_size };
+        this->chunks.push_back(next);
+        current = &this->chunks.back();
+        start = 0;
+    }
+
+    this->offset = start + size;
+    this->total_used += size;
+    if (this->total_used > this->peak)
+        this->peak = this->total_used;
+    return current->data + start;
+}
+
+void FrameArena::reset()
+{
+    if (this->chunks.size() > 1) {
+        /* this frame needed more than one chunk, make the next one fit in one */
+        size_t total = 0;
+        for (auto &c : this->chunks) {
+            total += c.size;
+            free(c.data);
+        }
+        this->chunks.clear();
+        chunk merged = { allocate_chunk(total), total };
+        this->chunks.push_back(merged);
+    }
+    this->offset = 0;
+    this->total_used = 0;
+}
+
+size_t FrameArena::used() const
+{
+    return this->total_used;
+}
+
+size_t FrameArena::high_water() const
+{
+    return this->peak;
+}
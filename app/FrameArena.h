@@ -0,0 +1,94 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+/*
+ * Bump allocator for data that lives for one frame. Allocation is a
+ * pointer increment, reset() releases everything at once. When a frame
+ * overflowed into extra chunks, reset() replaces them with a single
+ * chunk big enough for the whole frame, so a steady-state frame never
+ * reaches malloc.
+ */
+class FrameArena
+{
+public:
+    explicit FrameArena(size_t initial_size = 64 * 1024);
+    ~FrameArena();
+
+    void *allocate(size_t size, size_t align = alignof(max_align_t));
+    void reset();
+
+    size_t used() const;
+    size_t high_water() const;
+
+private:
+    struct chunk {
+        uint8_t *data;
+        size_t size;
+    };
+
+    std::vector<chunk> chunks;
+    size_t offset;
+    size_t total_used;
+    size_t peak;
+
+    FrameArena(const FrameArena &);
+    FrameArena &operator=(const FrameArena &);
+};
+
+/*
+ * Growable array of plain data elements (copied with memcpy, never
+ * destructed) backed by a FrameArena.
+ * Growth abandons the old block to the arena until its next reset.
+ */
+template <typename T>
+class ArenaVector
+{
+public:
+    explicit ArenaVector(FrameArena *arena) : arena(arena), items(nullptr), count(0), capacity(0) {}
+
+    /* forgets the contents, must be called whenever the arena is reset */
+    void clear() {
+        items = nullptr;
+        count = 0;
+        capacity = 0;
+    }
+
+    void push_back(const T &item) {
+        if (count == capacity)
+            grow();
+        items[count++] = item;
+    }
+
+    T &back() { return items[count - 1]; }
+    T &operator[](size_t i) { return items[i]; }
+    const T &operator[](size_t i) const { return items[i]; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    T *begin() { return items; }
+    T *end() { return items + count; }
+    const T *begin() const { return items; }
+    const T *end() const { return items + count; }
+
+private:
+    FrameArena *arena;
+    T *items;
+    size_t count;
+    size_t capacity;
+
+    void grow() {
+        size_t new_capacity = capacity ? capacity * 2 : 64;
+        T *bigger = (T *) arena->allocate(new_capacity * sizeof(T), alignof(T));
+        if (count)
+            memcpy(bigger, items, count * sizeof(T));
+        items = bigger;
+        capacity = new_capacity;
+    }
+};
+
+#endif /* FRAME_ARENA_H */
@@ -0,0 +1,42 @@
+#include "FrameSnapshot.h"
+#include "DiskCache.h"
+#include <stdio.h>
+
+static const char frame_snapshot_magic[4] = { 'H', 'S', 'F', 'S' };
+
+void FrameSnapshot::unmap()
+{
+    this->cached.unmap();
+}
+
+bool FrameSnapshot::loaded() const
+{
+    return this->cached.loaded();
+}
+
+std::string FrameSnapshot::path(const std::string &name, int32_t width, int32_t height)
+{
+    std::string directory = cache_directory();
+    if (directory.empty())
+        return directory;
+
+    char file[64];
+    snprintf(file, sizeof(file), "-%dx%d.raw", width, height);
+    return directory + "/snapshot-" + name + file;
+}
+
+struct file_image FrameSnapshot::file() const
+{
+    return this->cached.file();
+}
+
+/* snapshots are found by name, their key is always 0 */
+bool FrameSnapshot::load(const std::string &path, int32_t width, int32_t height)
+{
+    return this->cached.map(path, frame_snapshot_magic, FRAME_SNAPSHOT_VERSION, 0, width, height);
+}
+
+bool FrameSnapshot::save(const std::string &path, const uint32_t *pixels, int32_t width, int32_t height)
+{
+    return CachedImage::write(path, frame_snapshot_magic, FRAME_SNAPSHOT_VERSION, 0, width, height, pixels);
+}
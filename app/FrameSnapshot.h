@@ -0,0 +1,35 @@
+#ifndef FRAME_SNAPSHOT_H
+#define FRAME_SNAPSHOT_H
+
+#include <stdint.h>
+#include <string>
+#include "CachedImage.h"
+
+#define FRAME_SNAPSHOT_VERSION 2
+
+/*
+ * The last settled frame of a surface, kept in the cache directory so
+ * the next boot can commit it before the scene has painted anything.
+ * Snapshots are named after the surface's role and size; the content
+ * may be stale, it is only shown until the real frame replaces it.
+ */
+class FrameSnapshot
+{
+public:
+    /* empty without a cache directory */
+    static std::string path(const std::string &name, int32_t width, int32_t height);
+
+    bool load(const std::string &path, int32_t width, int32_t height);
+    bool loaded() const;
+    /* the snapshot file itself, for handing to the compositor */
+    struct file_image file() const;
+    void unmap();
+
+    /* pixels are width * height XRGB8888 without padding */
+    static bool save(const std::string &path, const uint32_t *pixels, int32_t width, int32_t height);
+
+private:
+    CachedImage cached;
+};
+
+#endif /* FRAME_SNAPSHOT_H */
@@ -0,0 +1,106 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+struct rect {
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+};
+
+/* damage lists longer than this collapse into their bounding box */
+#define MAX_DAMAGE_RECTS 16
+
+static inline rect make_rect(int32_t x, int32_t y, int32_t width, int32_t height)
+{
+    rect r = { x, y, width, height };
+    return r;
+}
+
+static inline bool rect_empty(const rect &r)
+{
+    return r.width <= 0 || r.height <= 0;
+}
+
+static inline rect rect_intersect(const rect &a, const rect &b)
+{
+    int32_t x1 = a.x > b.x ? a.x : b.x;
+    int32_t y1 = a.y > b.y ? a.y : b.y;
+    int32_t x2 = a.x + a.width < b.x + b.width ? a.x + a.width : b.x + b.width;
+    int32_t y2 = a.y + a.height < b.y + b.height ? a.y + a.height : b.y + b.height;
+
+    if (x2 <= x1 || y2 <= y1)
+        return make_rect(0, 0, 0, 0);
+    return make_rect(x1, y1, x2 - x1, y2 - y1);
+}
+
+static inline rect rect_bounds(const rect &a, const rect &b)
+{
+    if (rect_empty(a))
+        return b;
+    if (rect_empty(b))
+        return a;
+
+    int32_t x1 = a.x < b.x ? a.x : b.x;
+    int32_t y1 = a.y < b.y ? a.y : b.y;
+    int32_t x2 = a.x + a.width > b.x + b.width ? a.x + a.width : b.x + b.width;
+    int32_t y2 = a.y + a.height > b.y + b.height ? a.y + a.height : b.y + b.height;
+    return make_rect(x1, y1, x2 - x1, y2 - y1);
+}
+
+/* true when the rects overlap or share an edge */
+static inline bool rect_touches(const rect &a, const rect &b)
+{
+    return a.x <= b.x + b.width && b.x <= a.x + a.width &&
+           a.y <= b.y + b.height && b.y <= a.y + a.height;
+}
+
+static inline bool rect_contains(const rect &outer, const rect &inner)
+{
+    return inner.x >= outer.x && inner.y >= outer.y &&
+           inner.x + inner.width <= outer.x + outer.width &&
+           inner.y + inner.height <= outer.y + outer.height;
+}
+
+/*
+ * Adds r to a damage list, merging it with every rect it touches so the
+ * list stays small. Past MAX_DAMAGE_RECTS the list becomes its bounds.
+ */
+static inline void damage_add(std::vector<rect> &damage, rect r)
+{
+    if (rect_empty(r))
+        return;
+
+    size_t i = 0;
+    while (i < damage.size()) {
+        if (rect_touches(damage[i], r)) {
+            r = rect_bounds(damage[i], r);
+            damage[i] = damage.back();
+            damage.pop_back();
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+    damage.push_back(r);
+
+    if (damage.size() > MAX_DAMAGE_RECTS) {
+        rect all = damage[0];
+        for (auto &d : damage)
+            all = rect_bounds(all, d);
+        damage.clear();
+        damage.push_back(all);
+    }
+}
+
+static inline void damage_add_all(std::vector<rect> &damage, const std::vector<rect> &other)
+{
+    for (auto &r : other)
+        damage_add(damage, r);
+}
+
+#endif /* GEOMETRY_H */
@@ -0,0 +1,96 @@
+#include "GlyphAtlas.h"
+#include <string.h>
+
+/* a glyph goes on the first shelf it fits without wasting more than this */
+#define SHELF_SLACK 4
+/* blank row and column between neighbouring glyphs */
+#define GLYPH_PADDING 1
+
+GlyphAtlas::GlyphAtlas()
+    : pixels((size_t) GLYPH_ATLAS_SIZE * GLYPH_ATLAS_SIZE, 0)
+{
+    this->clears = 0;
+}
+
+uint64_t GlyphAtlas::key(int32_t size, uint32_t glyph_index)
+{
+    return ((uint64_t) (uint32_t) size << 32) | glyph_index;
+}
+
+const glyph_slot *GlyphAtlas::find(uint64_t key) const
+{
+    auto it = this->glyphs.find(key);
+    return it == this->glyphs.end() ? nullptr : &it->second;
+}
+
+const glyph_slot *GlyphAtlas::insert(uint64_t key, int32_t width, int32_t height,
+                                     int32_t left, int32_t top, int32_t advance)
+{
+    glyph_slot slot;
+    slot.area = make_rect(0, 0, 0, 0);
+    slot.left = left;
+    slot.top = top;
+    slot.advance = advance;
+
+    if (width > 0 && height > 0) {
+        int32_t padded_width = width + GLYPH_PADDING;
+        int32_t padded_height = height + GLYPH_PADDING;
+        if (padded_width > GLYPH_ATLAS_SIZE || padded_height > GLYPH_ATLAS_SIZE)
+            return nullptr;
+
+        shelf *target = nullptr;
+        for (auto &s : this->shelves) {
+            if (padded_height <= s.height && s.height - padded_height <= SHELF_SLACK &&
+                s.used + padded_width <= GLYPH_ATLAS_SIZE) {
+                target = &s;
+                break;
+            }
+        }
+        if (!target) {
+            int32_t y = this->shelves.empty() ? 0 : this->shelves.back().y + this->shelves.back().height;
+            if (y + padded_height > GLYPH_ATLAS_SIZE)
+                return nullptr;
+            shelf s = { y, padded_height, 0 };
+            this->shelves.push_back(s);
+            target = &this->shelves.back();
+        }
+
+        slot.area = make_rect(target->used, target->y, width, height);
+        target->used += padded_width;
+    }
+
+    return &(this->glyphs[key] = slot);
+}
+
+void GlyphAtlas::clear()
+{
+    this->glyphs.clear();
+    this->shelves.clear();
+    memset(this->pixels.data(), 0, this->pixels.size());
+    this->clears++;
+}
+
+uint8_t *GlyphAtlas::data()
+{
+    return this->pixels.data();
+}
+
+const uint8_t *GlyphAtlas::data() const
+{
+    return this->pixels.data();
+}
+
+int32_t GlyphAtlas::stride() const
+{
+    return GLYPH_ATLAS_SIZE;
+}
+
+size_t GlyphAtlas::glyph_count() const
+{
+    return this->glyphs.size();
+}
+
+uint32_t GlyphAtlas::clear_count() const
+{
+    return this->clears;
+}
@@ -0,0 +1,66 @@
+#ifndef GLYPH_ATLAS_H
+#define GLYPH_ATLAS_H
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include "Geometry.h"
+
+/* width and height of the 8-bit coverage texture */
+#define GLYPH_ATLAS_SIZE 512
+
+struct glyph_slot {
+    /* coverage in the atlas, empty for blank glyphs like spaces */
+    rect area;
+    /* bitmap offset right of the pen and up from the baseline */
+    int32_t left;
+    int32_t top;
+    /* pen advance in 26.6 fixed point */
+    int32_t advance;
+};
+
+/*
+ * Rasterized glyphs packed into one shared coverage texture on shelves,
+ * keyed by pixel size and glyph index, so a glyph is rasterized once no
+ * matter how many strings use it. Nothing is evicted individually; when
+ * the texture is full the owner clears it and rasterizes again.
+ */
+class GlyphAtlas
+{
+public:
+    GlyphAtlas();
+
+    static uint64_t key(int32_t size, uint32_t glyph_index);
+
+    const glyph_slot *find(uint64_t key) const;
+
+    /*
+     * Reserves width x height coverage for key and returns its slot, whose
+     * pixels the caller fills through data(). nullptr when the atlas is full.
+     */
+    const glyph_slot *insert(uint64_t key, int32_t width, int32_t height,
+                             int32_t left, int32_t top, int32_t advance);
+
+    void clear();
+
+    uint8_t *data();
+    const uint8_t *data() const;
+    int32_t stride() const;
+
+    size_t glyph_count() const;
+    uint32_t clear_count() const;
+
+private:
+    struct shelf {
+        int32_t y;
+        int32_t height;
+        int32_t used;
+    };
+
+    std::vector<uint8_t> pixels;
+    std::vector<shelf> shelves;
+    std::unordered_map<uint64_t, glyph_slot> glyphs;
+    uint32_t clears;
+};
+
+#endif /* GLYPH_ATLAS_H */
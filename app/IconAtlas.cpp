@@ -0,0 +1,246 @@
+#include "IconAtlas.h"
+#include "DiskCache.h"
+#include "ImageDecoder.h"
+#include "PixelKernels.h"
+#include "TaskScheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DEFAULT_ICON_DIR "/usr/share/icons/homescreen"
+/* cells wrap into a new row past this width */
+#define ICON_ATLAS_MAX_WIDTH 2048
+
+static const char icon_atlas_magic[4] = { 'H', 'S', 'I', 'C' };
+
+IconAtlas::IconAtlas()
+{
+}
+
+IconAtlas::~IconAtlas()
+{
+    unmap();
+}
+
+void IconAtlas::unmap()
+{
+    cache_unmap(this->cache);
+    std::vector<uint8_t>().swap(this->memory_head);
+    std::vector<uint32_t>().swap(this->memory_pixels);
+}
+
+const icon_atlas_header *IconAtlas::header() const
+{
+    if (this->cache.data)
+        return (const icon_atlas_header *) this->cache.data;
+    return (const icon_atlas_header *) this->memory_head.data();
+}
+
+const icon_atlas_entry *IconAtlas::entries() const
+{
+    return (const icon_atlas_entry *) (header() + 1);
+}
+
+const uint32_t *IconAtlas::pixels() const
+{
+    if (this->cache.data)
+        return (const uint32_t *) ((const uint8_t *) this->cache.data + header()->data_offset);
+    return this->memory_pixels.data();
+}
+
+bool IconAtlas::loaded() const
+{
+    return this->cache.data != nullptr || !this->memory_head.empty();
+}
+
+size_t IconAtlas::icon_count() const
+{
+    return loaded() ? header()->icon_count : 0;
+}
+
+const char *IconAtlas::app_id(size_t index) const
+{
+    return entries()[index].app_id;
+}
+
+bool IconAtlas::find(size_t index, int32_t size, scene_image &image) const
+{
+    if (index >= icon_count())
+        return false;
+
+    /* levels shrink, the last one still wide enough wins */
+    const icon_atlas_entry &entry = entries()[index];
+    int32_t best = 0;
+    for (int32_t level = 1; level < ICON_LEVELS; level++) {
+        if (entry.levels[level].width >= size)
+            best = level;
+    }
+
+    const rect &area = entry.levels[best];
+    if (rect_empty(area))
+        return false;
+
+    const icon_atlas_header *h = header();
+    image.pixels = pixels() + (size_t) area.y * (h->stride / 4) + area.x;
+    image.width = area.width;
+    image.height = area.height;
+    image.stride = h->stride / 4;
+    image.opaque = false;
+    return true;
+}
+
+std::string IconAtlas::icon_path(const std::string &app_id)
+{
+    static const char *extensions[] = { ".qoi", ".png", ".jpg" };
+    const char *directory = getenv("HOMESCREEN_ICON_DIR");
+    if (!directory)
+        directory = DEFAULT_ICON_DIR;
+
+    for (auto extension : extensions) {
+        std::string path = std::string(directory) + "/" + app_id + extension;
+        if (access(path.c_str(), R_OK) == 0)
+            return path;
+    }
+    return std::string();
+}
+
+bool IconAtlas::map_cache(const std::string &cache_path, uint64_t key)
+{
+    icon_atlas_header h;
+    return cache_map(cache_path, &h, sizeof(h), [&](uint64_t &data_offset, uint64_t &data_size) {
+        data_offset = h.data_offset;
+        data_size = (uint64_t) h.stride * h.height;
+        return memcmp(h.magic, icon_atlas_magic, sizeof(h.magic)) == 0 &&
+               h.version == ICON_ATLAS_VERSION && h.key == key &&
+               h.width > 0 && h.height > 0 && h.stride == h.width * 4 &&
+               sizeof(icon_atlas_header) + (uint64_t) h.icon_count * sizeof(icon_atlas_entry) <= h.data_offset;
+    }, this->cache);
+}
+
+void IconAtlas::build(const std::vector<std::string> &app_ids, const std::vector<std::string> &paths,
+                      int32_t scale, uint64_t key, std::vector<uint8_t> &head, std::vector<uint32_t> &pixels,
+                      TaskScheduler *scheduler)
+{
+    int32_t count = (int32_t) app_ids.size();
+    int32_t base = ICON_SIZE * scale;
+    int32_t cell_width = base + base / 2;
+    int32_t columns = ICON_ATLAS_MAX_WIDTH / cell_width;
+    columns = columns < 1 ? 1 : columns > count ? count : columns;
+    int32_t width = columns * cell_width;
+    int32_t height = (count + columns - 1) / columns * base;
+
+    pixels.assign((size_t) width * height, 0);
+    std::vector<icon_atlas_entry> atlas_entries(count);
+    memset(atlas_entries.data(), 0, atlas_entries.size() * sizeof(icon_atlas_entry));
+
+    /* every icon writes its own cell and entry, they decode in parallel */
+    scheduler->parallel_for(0, count, 1, [&](int32_t begin, int32_t end) {
+        for (int32_t i = begin; i < end; i++) {
+            icon_atlas_entry &entry = atlas_entries[i];
+            snprintf(entry.app_id, sizeof(entry.app_id), "%s", app_ids[i].c_str());
+
+            decoded_image decoded;
+            if (!decode_image(paths[i].c_str(), decoded))
+                continue;
+
+            int32_t cell_x = (i % columns) * cell_width;
+            int32_t cell_y = (i / columns) * base;
+            for (int32_t level = 0; level < ICON_LEVELS; level++) {
+                int32_t size = base >> level;
+                if (size < 1)
+                    break;
+                int32_t x = level == 0 ? cell_x : cell_x + base;
+                int32_t y = level <= 1 ? cell_y : cell_y + base - (base >> (level - 1));
+
+                /* fit into the square, keeping the aspect ratio */
+                int32_t fit_width = size, fit_height = size;
+                if (decoded.width > decoded.height)
+                    fit_height = (int32_t) ((int64_t) size * decoded.height / decoded.width);
+                else
+                    fit_width = (int32_t) ((int64_t) size * decoded.width / decoded.height);
+                fit_width = fit_width > 0 ? fit_width : 1;
+                fit_height = fit_height > 0 ? fit_height : 1;
+
+                uint32_t *dst = pixels.data() + (size_t) (y + (size - fit_height) / 2) * width +
+                                x + (size - fit_width) / 2;
+                resample(dst, width, fit_width, fit_height, decoded.pixels.data(), decoded.width,
+                         make_rect(0, 0, decoded.width, decoded.height));
+                entry.levels[level] = make_rect(x, y, size, size);
+            }
+        }
+    });
+
+    icon_atlas_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, icon_atlas_magic, sizeof(h.magic));
+    h.version = ICON_ATLAS_VERSION;
+    h.key = key;
+    h.width = width;
+    h.height = height;
+    h.stride = width * 4;
+    h.scale = scale;
+    h.icon_count = (uint32_t) count;
+    size_t header_size = sizeof(h) + atlas_entries.size() * sizeof(icon_atlas_entry);
+    h.data_offset = (header_size + CACHE_PAGE_SIZE - 1) / CACHE_PAGE_SIZE * CACHE_PAGE_SIZE;
+
+    head.resize(header_size);
+    memcpy(head.data(), &h, sizeof(h));
+    memcpy(head.data() + sizeof(h), atlas_entries.data(), atlas_entries.size() * sizeof(icon_atlas_entry));
+}
+
+bool IconAtlas::load(const std::vector<std::string> &app_ids, int32_t scale, TaskScheduler *scheduler)
+{
+    std::string directory = cache_directory();
+    scale = scale > 0 ? scale : 1;
+
+    /* the key covers everything the packed pixels depend on */
+    std::vector<std::string> ids, paths;
+    char stamp[64];
+    snprintf(stamp, sizeof(stamp), "%d", scale);
+    std::string key_text = stamp;
+    for (auto &id : app_ids) {
+        if (id.empty() || id.size() >= ICON_ID_SIZE)
+            continue;
+        std::string path = icon_path(id);
+        struct stat st;
+        if (path.empty() || stat(path.c_str(), &st) < 0)
+            continue;
+
+        snprintf(stamp, sizeof(stamp), "|%llu|%lld", (unsigned long long) st.st_size, (long long) st.st_mtime);
+        key_text += "|" + id + "|" + path + stamp;
+        ids.push_back(id);
+        paths.push_back(path);
+    }
+    if (ids.empty())
+        return false;
+
+    uint64_t key = cache_hash(key_text.c_str());
+    char name[64];
+    snprintf(name, sizeof(name), "/icons-%016llx.raw", (unsigned long long) key);
+    std::string cache_path = directory.empty() ? std::string() : directory + name;
+
+    unmap();
+    if (!cache_path.empty() && map_cache(cache_path, key)) {
+        fprintf(stderr, "Mapped cached icon atlas %s\n", cache_path.c_str());
+        return true;
+    }
+
+    fprintf(stderr, "Packing %zu icons at scale %d\n", ids.size(), scale);
+    std::vector<uint8_t> head;
+    std::vector<uint32_t> pixels;
+    build(ids, paths, scale, key, head, pixels, scheduler);
+
+    const icon_atlas_header *h = (const icon_atlas_header *) head.data();
+    if (!cache_path.empty() &&
+        cache_write(cache_path, head.data(), head.size(), pixels.data(),
+                    pixels.size() * sizeof(uint32_t), (off_t) h->data_offset) &&
+        map_cache(cache_path, key))
+        return true;
+
+    fprintf(stderr, "Icon atlas not cached, it is kept in memory\n");
+    this->memory_head.swap(head);
+    this->memory_pixels.swap(pixels);
+    return true;
+}
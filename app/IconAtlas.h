@@ -0,0 +1,87 @@
+#ifndef ICON_ATLAS_H
+#define ICON_ATLAS_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "DiskCache.h"
+#include "SceneGraph.h"
+
+class TaskScheduler;
+
+#define ICON_ATLAS_VERSION 1
+/* launcher icon size at output scale 1 */
+#define ICON_SIZE 48
+/* full size, then every half down to a quarter */
+#define ICON_LEVELS 3
+#define ICON_ID_SIZE 64
+
+/* start of an icon atlas cache file: the entries follow, the pixels are at data_offset */
+struct icon_atlas_header {
+    char magic[4];
+    uint32_t version;
+    /* hash of the app ids, their icon files and the scale */
+    uint64_t key;
+    int32_t width;
+    int32_t height;
+    int32_t stride;
+    int32_t scale;
+    uint32_t icon_count;
+    uint32_t reserved;
+    uint64_t data_offset;
+};
+
+struct icon_atlas_entry {
+    char app_id[ICON_ID_SIZE];
+    /* largest first, level i is (ICON_SIZE * scale) >> i wide */
+    rect levels[ICON_LEVELS];
+};
+
+/*
+ * Launcher icons decoded once, scaled to every size needed at the
+ * output's scale and packed into one premultiplied ARGB image, so
+ * drawing an icon is a blit out of contiguous memory. Each icon takes
+ * a cell with its full size level on the left and the smaller ones
+ * stacked on the right. The packed image is kept in the cache
+ * directory and mapped on later loads, or only in memory when it
+ * cannot be written there; adding an app or touching an icon file packs
+ * a new one.
+ *
+ * Icons are looked up as <HOMESCREEN_ICON_DIR>/<app_id>.{qoi,png,jpg};
+ * apps without one are left out.
+ */
+class IconAtlas
+{
+public:
+    IconAtlas();
+    ~IconAtlas();
+
+    /* decodes in parallel on the scheduler on a cache miss, run it off the dispatch thread */
+    bool load(const std::vector<std::string> &app_ids, int32_t scale, TaskScheduler *scheduler);
+
+    bool loaded() const;
+    size_t icon_count() const;
+    const char *app_id(size_t index) const;
+
+    /* the smallest level at least size pixels wide, or the largest */
+    bool find(size_t index, int32_t size, scene_image &image) const;
+
+    static std::string icon_path(const std::string &app_id);
+
+private:
+    mapped_cache_file cache;
+    /* the header and entries, and the pixels, of an atlas not in the cache */
+    std::vector<uint8_t> memory_head;
+    std::vector<uint32_t> memory_pixels;
+
+    const icon_atlas_header *header() const;
+    const icon_atlas_entry *entries() const;
+    const uint32_t *pixels() const;
+    bool map_cache(const std::string &cache_path, uint64_t key);
+    void build(const std::vector<std::string> &app_ids, const std::vector<std::string> &paths,
+               int32_t scale, uint64_t key, std::vector<uint8_t> &head, std::vector<uint32_t> &pixels,
+               TaskScheduler *scheduler);
+    void unmap();
+};
+
+#endif /* ICON_ATLAS_H */
@@ -0,0 +1,288 @@
+#include "ImageDecoder.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef HAVE_LIBPNG
+#include <png.h>
+#endif
+#ifdef HAVE_LIBJPEG
+#include <setjmp.h>
+#include <jpeglib.h>
+#endif
+
+/* larger images are refused rather than risking overflow or exhaustion */
+#define MAX_IMAGE_DIMENSION 16384
+
+static bool read_file(const char *path, std::vector<uint8_t> &data)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "opening image %s failed: %m\n", path);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return false;
+    }
+
+    data.resize(st.st_size);
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = read(fd, data.data() + done, data.size() - done);
+        if (n <= 0) {
+            fprintf(stderr, "reading image %s failed: %m\n", path);
+            close(fd);
+            return false;
+        }
+        done += n;
+    }
+    close(fd);
+    return true;
+}
+
+static inline uint32_t premultiply(uint32_t r, uint32_t g, uint32_t b, uint32_t a)
+{
+    if (a != 255) {
+        r = (r * a + 127) / 255;
+        g = (g * a + 127) / 255;
+        b = (b * a + 127) / 255;
+    }
+    return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+static bool valid_size(const char *path, uint32_t width, uint32_t height)
+{
+    if (width == 0 || height == 0 || width > MAX_IMAGE_DIMENSION || height > MAX_IMAGE_DIMENSION) {
+        fprintf(stderr, "image %s has unsupported size %ux%u\n", path, width, height);
+        return false;
+    }
+    return true;
+}
+
+/* QOI, see https://qoiformat.org/qoi-specification.pdf */
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xc0
+#define QOI_OP_RGB 0xfe
+#define QOI_OP_RGBA 0xff
+#define QOI_MASK_2 0xc0
+#define QOI_HEADER_SIZE 14
+
+static uint32_t read_be32(const uint8_t *p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+static bool decode_qoi(const char *path, const std::vector<uint8_t> &data, decoded_image &image)
+{
+    if (data.size() < QOI_HEADER_SIZE)
+        return false;
+
+    uint32_t width = read_be32(&data[4]);
+    uint32_t height = read_be32(&data[8]);
+    if (!valid_size(path, width, height))
+        return false;
+
+    image.width = (int32_t) width;
+    image.height = (int32_t) height;
+    image.pixels.resize((size_t) width * height);
+    image.opaque = true;
+
+    uint8_t index[64][4];
+    memset(index, 0, sizeof(index));
+    uint8_t r = 0, g = 0, b = 0, a = 255;
+    size_t p = QOI_HEADER_SIZE;
+    int32_t run = 0;
+
+    for (auto &pixel : image.pixels) {
+        if (run > 0) {
+            run--;
+        } else if (p < data.size()) {
+            uint8_t op = data[p++];
+
+            if (op == QOI_OP_RGB) {
+                if (p + 3 > data.size())
+                    return false;
+                r = data[p++];
+                g = data[p++];
+                b = data[p++];
+            } else if (op == QOI_OP_RGBA) {
+                if (p + 4 > data.size())
+                    return false;
+                r = data[p++];
+                g = data[p++];
+                b = data[p++];
+                a = data[p++];
+            } else if ((op & QOI_MASK_2) == QOI_OP_INDEX) {
+                r = index[op][0];
+                g = index[op][1];
+                b = index[op][2];
+                a = index[op][3];
+            } else if ((op & QOI_MASK_2) == QOI_OP_DIFF) {
+                r += ((op >> 4) & 0x03) - 2;
+                g += ((op >> 2) & 0x03) - 2;
+                b += (op & 0x03) - 2;
+            } else if ((op & QOI_MASK_2) == QOI_OP_LUMA) {
+                if (p + 1 > data.size())
+                    return false;
+                uint8_t next = data[p++];
+                int dg = (op & 0x3f) - 32;
+                r += dg - 8 + ((next >> 4) & 0x0f);
+                g += dg;
+                b += dg - 8 + (next & 0x0f);
+            } else {
+                run = op & 0x3f;
+            }
+
+            uint8_t *slot = index[(r * 3 + g * 5 + b * 7 + a * 11) % 64];
+            slot[0] = r;
+            slot[1] = g;
+            slot[2] = b;
+            slot[3] = a;
+        } else {
+            fprintf(stderr, "image %s is truncated\n", path);
+            return false;
+        }
+
+        pixel = premultiply(r, g, b, a);
+        if (a != 255)
+            image.opaque = false;
+    }
+    return true;
+}
+
+#ifdef HAVE_LIBPNG
+static bool decode_png(const char *path, const std::vector<uint8_t> &data, decoded_image &image)
+{
+    png_image png;
+    memset(&png, 0, sizeof(png));
+    png.version = PNG_IMAGE_VERSION;
+
+    if (!png_image_begin_read_from_memory(&png, data.data(), data.size())) {
+        fprintf(stderr, "decoding png %s failed: %s\n", path, png.message);
+        return false;
+    }
+    if (!valid_size(path, png.width, png.height)) {
+        png_image_free(&png);
+        return false;
+    }
+
+    /* decoded as B, G, R, A bytes and repacked into premultiplied words below */
+    png.format = PNG_FORMAT_BGRA;
+    image.width = (int32_t) png.width;
+    image.height = (int32_t) png.height;
+    image.pixels.resize((size_t) png.width * png.height);
+    if (!png_image_finish_read(&png, nullptr, image.pixels.data(), 0, nullptr)) {
+        fprintf(stderr, "decoding png %s failed: %s\n", path, png.message);
+        return false;
+    }
+
+    image.opaque = true;
+    for (auto &pixel : image.pixels) {
+        const uint8_t *bytes = (const uint8_t *) &pixel;
+        uint32_t a = bytes[3];
+        pixel = premultiply(bytes[2], bytes[1], bytes[0], a);
+        if (a != 255)
+            image.opaque = false;
+    }
+    return true;
+}
+#endif
+
+#ifdef HAVE_LIBJPEG
+struct jpeg_error_jump {
+    struct jpeg_error_mgr manager;
+    jmp_buf jump;
+};
+
+static void jpeg_error_exit(j_common_ptr info)
+{
+    struct jpeg_error_jump *error = (struct jpeg_error_jump *) info->err;
+    char message[JMSG_LENGTH_MAX];
+    info->err->format_message(info, message);
+    fprintf(stderr, "decoding jpeg failed: %s\n", message);
+    longjmp(error->jump, 1);
+}
+
+static bool decode_jpeg(const char *path, const std::vector<uint8_t> &data, decoded_image &image)
+{
+    struct jpeg_decompress_struct info;
+    struct jpeg_error_jump error;
+    std::vector<uint8_t> row;
+
+    info.err = jpeg_std_error(&error.manager);
+    error.manager.error_exit = jpeg_error_exit;
+    if (setjmp(error.jump)) {
+        jpeg_destroy_decompress(&info);
+        return false;
+    }
+
+    jpeg_create_decompress(&info);
+    jpeg_mem_src(&info, (unsigned char *) data.data(), data.size());
+    jpeg_read_header(&info, TRUE);
+    info.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&info);
+
+    if (!valid_size(path, info.output_width, info.output_height)) {
+        jpeg_destroy_decompress(&info);
+        return false;
+    }
+
+    image.width = (int32_t) info.output_width;
+    image.height = (int32_t) info.output_height;
+    image.pixels.resize((size_t) image.width * image.height);
+    image.opaque = true;
+    row.resize((size_t) image.width * 3);
+
+    while (info.output_scanline < info.output_height) {
+        uint32_t *out = image.pixels.data() + (size_t) info.output_scanline * image.width;
+        JSAMPROW rows[1] = { row.data() };
+        jpeg_read_scanlines(&info, rows, 1);
+        for (int32_t x = 0; x < image.width; x++)
+            out[x] = premultiply(row[x * 3], row[x * 3 + 1], row[x * 3 + 2], 255);
+    }
+
+    jpeg_finish_decompress(&info);
+    jpeg_destroy_decompress(&info);
+    return true;
+}
+#endif
+
+bool decode_image(const char *path, decoded_image &image)
+{
+    static const uint8_t png_signature[] = { 0x89, 'P', 'N', 'G' };
+    static const uint8_t jpeg_signature[] = { 0xff, 0xd8, 0xff };
+    std::vector<uint8_t> data;
+
+    if (!read_file(path, data))
+        return false;
+
+    if (data.size() >= 4 && memcmp(data.data(), "qoif", 4) == 0)
+        return decode_qoi(path, data, image);
+
+    if (data.size() >= sizeof(png_signature) && memcmp(data.data(), png_signature, sizeof(png_signature)) == 0) {
+#ifdef HAVE_LIBPNG
+        return decode_png(path, data, image);
+#else
+        fprintf(stderr, "image %s is a png, built without libpng\n", path);
+        return false;
+#endif
+    }
+
+    if (data.size() >= sizeof(jpeg_signature) && memcmp(data.data(), jpeg_signature, sizeof(jpeg_signature)) == 0) {
+#ifdef HAVE_LIBJPEG
+        return decode_jpeg(path, data, image);
+#else
+        fprintf(stderr, "image %s is a jpeg, built without libjpeg\n", path);
+        return false;
+#endif
+    }
+
+    fprintf(stderr, "image %s has an unknown format\n", path);
+    return false;
+}
@@ -0,0 +1,23 @@
+#ifndef IMAGE_DECODER_H
+#define IMAGE_DECODER_H
+
+#include <stdint.h>
+#include <vector>
+
+/* premultiplied ARGB8888, stride == width */
+struct decoded_image {
+    std::vector<uint32_t> pixels;
+    int32_t width = 0;
+    int32_t height = 0;
+    bool opaque = true;
+};
+
+/*
+ * Decodes a QOI, PNG or JPEG file, told apart by their signatures. QOI
+ * is always available; PNG and JPEG need libpng and libjpeg at build
+ * time (HAVE_LIBPNG, HAVE_LIBJPEG). Returns false and prints why when
+ * the file cannot be decoded.
+ */
+bool decode_image(const char *path, decoded_image &image);
+
+#endif /* IMAGE_DECODER_H */
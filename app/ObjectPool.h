@@ -0,0 +1,79 @@
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+/*
+ * Fixed-size object allocator for long-lived objects that come and go
+ * over the life of the process (surfaces, buffers). Objects are carved
+ * from slabs and recycled through a free list, so churn neither
+ * fragments the heap nor contends on malloc. Slabs are only returned
+ * when the pool itself goes away.
+ */
+template <typename T, size_t SlabObjects = 32>
+class ObjectPool
+{
+public:
+    ObjectPool() : free_list(nullptr) {}
+
+    ~ObjectPool() {
+        for (auto slab : slabs)
+            free(slab);
+    }
+
+    template <typename... Args>
+    T *create(Args &&... args) {
+        void *memory;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!free_list)
+                add_slab();
+            memory = free_list;
+            free_list = free_list->next;
+        }
+        return new (memory) T(std::forward<Args>(args)...);
+    }
+
+    void destroy(T *object) {
+        if (!object)
+            return;
+
+        object->~T();
+        std::lock_guard<std::mutex> lock(mutex);
+        slot *s = (slot *) object;
+        s->next = free_list;
+        free_list = s;
+    }
+
+private:
+    union slot {
+        slot *next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    std::mutex mutex;
+    slot *free_list;
+    std::vector<slot *> slabs;
+
+    void add_slab() {
+        slot *slab = (slot *) malloc(sizeof(slot) * SlabObjects);
+        if (!slab) {
+            fprintf(stderr, "object pool: allocating a slab of %zu B failed\n", sizeof(slot) * SlabObjects);
+            exit(1);
+        }
+
+        for (size_t i = 0; i < SlabObjects; i++) {
+            slab[i].next = free_list;
+            free_list = &slab[i];
+        }
+        slabs.push_back(slab);
+    }
+};
+
+#endif /* OBJECT_POOL_H */
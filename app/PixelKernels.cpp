@@ -0,0 +1,490 @@
+#include "PixelKernels.h"
+#include <math.h>
+#include <string.h>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+void fill_rect(uint32_t *dst, int32_t dst_stride, const rect &area, uint32_t color)
+{
+    for (int32_t y = 0; y < area.height; y++) {
+        uint32_t *row = dst + (area.y + y) * dst_stride + area.x;
+        for (int32_t x = 0; x < area.width; x++)
+            row[x] = color;
+    }
+}
+
+void blit(uint32_t *dst, int32_t dst_stride, const rect &area,
+          const uint32_t *src, int32_t src_stride, int32_t src_x, int32_t src_y)
+{
+    for (int32_t y = 0; y < area.height; y++) {
+        memcpy(dst + (area.y + y) * dst_stride + area.x,
+               src + (src_y + y) * src_stride + src_x,
+               area.width * sizeof(uint32_t));
+    }
+}
+
+void copy_rect_streaming(uint32_t *dst, const uint32_t *src, int32_t stride, const rect &area)
+{
+    for (int32_t y = 0; y < area.height; y++) {
+        uint32_t *d = dst + (area.y + y) * stride + area.x;
+        const uint32_t *s = src + (area.y + y) * stride + area.x;
+        int32_t x = 0;
+#ifdef __SSE2__
+        /* scalar head up to 16 byte destination alignment, then 4 pixels per store */
+        for (; x < area.width && ((uintptr_t) (d + x) & 15); x++)
+            d[x] = s[x];
+        for (; x + 4 <= area.width; x += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (s + x));
+            _mm_stream_si128((__m128i *) (d + x), v);
+        }
+#endif
+        /* NEON has no streaming store, libc's memcpy is as good as it gets there */
+        if (x < area.width)
+            memcpy(d + x, s + x, (area.width - x) * sizeof(uint32_t));
+    }
+#ifdef __SSE2__
+    /* streaming stores must be visible before the buffer is handed over */
+    _mm_sfence();
+#endif
+}
+
+static inline uint32_t blend_pixel(uint32_t s, uint32_t d)
+{
+    uint32_t inv = 255 - (s >> 24);
+    if (inv == 0)
+        return s;
+    if (inv == 255)
+        return d;
+
+    /* two channels per multiply, (x * inv) / 255 rounded */
+    uint32_t rb = (d & 0x00ff00ff) * inv + 0x00800080;
+    rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+    uint32_t ag = ((d >> 8) & 0x00ff00ff) * inv + 0x00800080;
+    ag = (ag + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+    return s + (rb | ag);
+}
+
+void blend_color(uint32_t *dst, int32_t dst_stride, const rect &area, uint32_t color)
+{
+    for (int32_t y = 0; y < area.height; y++) {
+        uint32_t *d = dst + (area.y + y) * dst_stride + area.x;
+        for (int32_t x = 0; x < area.width; x++)
+            d[x] = blend_pixel(color, d[x]);
+    }
+}
+
+void blend(uint32_t *dst, int32_t dst_stride, const rect &area,
+           const uint32_t *src, int32_t src_stride, int32_t src_x, int32_t src_y)
+{
+    for (int32_t y = 0; y < area.height; y++) {
+        uint32_t *d = dst + (area.y + y) * dst_stride + area.x;
+        const uint32_t *s = src + (src_y + y) * src_stride + src_x;
+        for (int32_t x = 0; x < area.width; x++)
+            d[x] = blend_pixel(s[x], d[x]);
+    }
+}
+
+/* color scaled by coverage, rounded like blend_pixel() */
+static inline uint32_t scale_color(uint32_t color, uint32_t coverage)
+{
+    uint32_t rb = (color & 0x00ff00ff) * coverage + 0x00800080;
+    rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+    uint32_t ag = ((color >> 8) & 0x00ff00ff) * coverage + 0x00800080;
+    ag = (ag + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+    return rb | ag;
+}
+
+#ifdef __SSE2__
+/* (x * y) / 255 rounded, per 16-bit lane */
+static inline __m128i mul_div255(__m128i x, __m128i y)
+{
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(x, y), _mm_set1_epi16(0x80));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+/* two pixels: source over of color scaled by their coverage (both in 16-bit lanes) */
+static inline __m128i blend_mask_pair(__m128i d, __m128i color, __m128i coverage)
+{
+    __m128i s = mul_div255(color, coverage);
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    __m128i inv = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+    return _mm_add_epi16(s, mul_div255(d, inv));
+}
+#elif defined(__ARM_NEON)
+/* the four lanes of v, each repeated four times: lanes 0 and 1 in lo, 2 and 3 in hi */
+static inline void repeat_lanes(uint16x4_t v, uint16x8_t &lo, uint16x8_t &hi)
+{
+    uint16x4x2_t pairs = vzip_u16(v, v);
+    uint16x4x2_t first = vzip_u16(pairs.val[0], pairs.val[0]);
+    uint16x4x2_t second = vzip_u16(pairs.val[1], pairs.val[1]);
+    lo = vcombine_u16(first.val[0], first.val[1]);
+    hi = vcombine_u16(second.val[0], second.val[1]);
+}
+
+/* (x * y) / 255 rounded, per 16-bit lane */
+static inline uint16x8_t mul_div255(uint16x8_t x, uint16x8_t y)
+{
+    uint16x8_t t = vaddq_u16(vmulq_u16(x, y), vdupq_n_u16(0x80));
+    return vshrq_n_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), 8);
+}
+
+/* the same two pixels as the SSE2 blend_mask_pair() */
+static inline uint16x8_t blend_mask_pair(uint16x8_t d, uint16x8_t color, uint16x8_t coverage)
+{
+    uint16x8_t s = mul_div255(color, coverage);
+    uint16x8_t alpha = vcombine_u16(vdup_lane_u16(vget_low_u16(s), 3), vdup_lane_u16(vget_high_u16(s), 3));
+    uint16x8_t inv = vsubq_u16(vdupq_n_u16(255), alpha);
+    return vaddq_u16(s, mul_div255(d, inv));
+}
+#endif
+
+void blend_mask(uint32_t *dst, int32_t dst_stride, const rect &area, uint32_t color,
+                const uint8_t *mask, int32_t mask_stride, int32_t src_x, int32_t src_y)
+{
+#ifdef __SSE2__
+    __m128i zero = _mm_setzero_si128();
+    __m128i color16 = _mm_unpacklo_epi8(_mm_set1_epi32((int32_t) color), zero);
+#elif defined(__ARM_NEON)
+    uint16x8_t color16 = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(color)));
+#endif
+    for (int32_t y = 0; y < area.height; y++) {
+        uint32_t *d = dst + (area.y + y) * dst_stride + area.x;
+        const uint8_t *m = mask + (src_y + y) * mask_stride + src_x;
+        int32_t x = 0;
+#ifdef __SSE2__
+        for (; x + 4 <= area.width; x += 4) {
+            uint32_t coverage;
+            memcpy(&coverage, m + x, sizeof(coverage));
+            if (coverage == 0)
+                continue;
+
+            /* coverage of each pixel repeated over its four channels */
+            __m128i c = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int32_t) coverage), zero);
+            c = _mm_unpacklo_epi16(c, c);
+            __m128i c01 = _mm_unpacklo_epi32(c, c);
+            __m128i c23 = _mm_unpackhi_epi32(c, c);
+
+            __m128i pixels = _mm_loadu_si128((const __m128i *) (d + x));
+            __m128i lo = blend_mask_pair(_mm_unpacklo_epi8(pixels, zero), color16, c01);
+            __m128i hi = blend_mask_pair(_mm_unpackhi_epi8(pixels, zero), color16, c23);
+            _mm_storeu_si128((__m128i *) (d + x), _mm_packus_epi16(lo, hi));
+        }
+#elif defined(__ARM_NEON)
+        for (; x + 4 <= area.width; x += 4) {
+            uint32_t coverage;
+            memcpy(&coverage, m + x, sizeof(coverage));
+            if (coverage == 0)
+                continue;
+
+            uint16x8_t c_lo, c_hi;
+            repeat_lanes(vget_low_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(coverage)))), c_lo, c_hi);
+
+            uint8x16_t pixels = vld1q_u8((const uint8_t *) (d + x));
+            uint16x8_t lo = blend_mask_pair(vmovl_u8(vget_low_u8(pixels)), color16, c_lo);
+            uint16x8_t hi = blend_mask_pair(vmovl_u8(vget_high_u8(pixels)), color16, c_hi);
+            vst1q_u8((uint8_t *) (d + x), vcombine_u8(vqmovn_u16(lo), vqmovn_u16(hi)));
+        }
+#endif
+        for (; x < area.width; x++) {
+            if (m[x])
+                d[x] = blend_pixel(scale_color(color, m[x]), d[x]);
+        }
+    }
+}
+
+/* one channel at a time, the same arithmetic as the SSE2 and NEON paths */
+static inline uint32_t gradient_pixel(uint32_t from, uint32_t to, uint16_t t, uint8_t threshold)
+{
+    int32_t weight = t >> 1;
+    uint32_t pixel = 0;
+    for (int32_t shift = 0; shift < 32; shift += 8) {
+        int32_t f = (from >> shift) & 0xff;
+        int32_t delta = ((int32_t) ((to >> shift) & 0xff) - f) * 128;
+        int32_t v = ((f << 6) + ((delta * weight) >> 16) + threshold) >> 6;
+        pixel |= (uint32_t) (v < 0 ? 0 : v > 255 ? 255 : v) << shift;
+    }
+    return pixel;
+}
+
+#ifdef __ARM_NEON
+/* two pixels: base + (delta * w) >> 16 + d per 16-bit lane, like _mm_mulhi_epi16 */
+static inline uint8x8_t gradient_pair(int16x8_t base, int16x8_t delta, uint16x8_t w, uint16x8_t d)
+{
+    int16x8_t weight = vreinterpretq_s16_u16(w);
+    int16x4_t lo = vshrn_n_s32(vmull_s16(vget_low_s16(delta), vget_low_s16(weight)), 16);
+    int16x4_t hi = vshrn_n_s32(vmull_s16(vget_high_s16(delta), vget_high_s16(weight)), 16);
+    int16x8_t v = vaddq_s16(vaddq_s16(base, vcombine_s16(lo, hi)), vreinterpretq_s16_u16(d));
+    return vqshrun_n_s16(v, 6);
+}
+#endif
+
+void gradient_span(uint32_t *dst, const uint16_t *t, int32_t count, uint32_t from, uint32_t to,
+                   const uint8_t *dither)
+{
+    int32_t x = 0;
+#ifdef __SSE2__
+    /* channels in 16-bit lanes as 10.6 fixed point, two pixels per register */
+    __m128i zero = _mm_setzero_si128();
+    __m128i from16 = _mm_unpacklo_epi8(_mm_set1_epi32((int32_t) from), zero);
+    __m128i to16 = _mm_unpacklo_epi8(_mm_set1_epi32((int32_t) to), zero);
+    __m128i base = _mm_slli_epi16(from16, 6);
+    __m128i delta = _mm_slli_epi16(_mm_sub_epi16(to16, from16), 7);
+
+    for (; x + 4 <= count; x += 4) {
+        /* weight and threshold of each pixel repeated over its four channels */
+        __m128i w = _mm_srli_epi16(_mm_loadl_epi64((const __m128i *) (t + x)), 1);
+        w = _mm_unpacklo_epi16(w, w);
+        uint32_t thresholds;
+        memcpy(&thresholds, dither + (x & 7), sizeof(thresholds));
+        __m128i d = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int32_t) thresholds), zero);
+        d = _mm_unpacklo_epi16(d, d);
+
+        __m128i lo = _mm_add_epi16(_mm_add_epi16(base, _mm_mulhi_epi16(delta, _mm_unpacklo_epi32(w, w))),
+                                   _mm_unpacklo_epi32(d, d));
+        __m128i hi = _mm_add_epi16(_mm_add_epi16(base, _mm_mulhi_epi16(delta, _mm_unpackhi_epi32(w, w))),
+                                   _mm_unpackhi_epi32(d, d));
+        _mm_storeu_si128((__m128i *) (dst + x),
+                         _mm_packus_epi16(_mm_srai_epi16(lo, 6), _mm_srai_epi16(hi, 6)));
+    }
+#elif defined(__ARM_NEON)
+    /* the same lanes as the SSE2 path */
+    int16x8_t from16 = vreinterpretq_s16_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(from))));
+    int16x8_t to16 = vreinterpretq_s16_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(to))));
+    int16x8_t base = vshlq_n_s16(from16, 6);
+    int16x8_t delta = vshlq_n_s16(vsubq_s16(to16, from16), 7);
+
+    for (; x + 4 <= count; x += 4) {
+        uint16x8_t w_lo, w_hi, d_lo, d_hi;
+        repeat_lanes(vshr_n_u16(vld1_u16(t + x), 1), w_lo, w_hi);
+        uint32_t thresholds;
+        memcpy(&thresholds, dither + (x & 7), sizeof(thresholds));
+        repeat_lanes(vget_low_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(thresholds)))), d_lo, d_hi);
+
+        vst1q_u8((uint8_t *) (dst + x), vcombine_u8(gradient_pair(base, delta, w_lo, d_lo),
+                                                     gradient_pair(base, delta, w_hi, d_hi)));
+    }
+#endif
+    for (; x < count; x++)
+        dst[x] = gradient_pixel(from, to, t[x], dither[x & 7]);
+}
+
+static const uint8_t bayer4[4][4] = {
+    {  0,  8,  2, 10 },
+    { 12,  4, 14,  6 },
+    {  3, 11,  1,  9 },
+    { 15,  7, 13,  5 }
+};
+
+/* the threshold is scaled to each channel's step, 8 for five bits and 4 for six */
+static inline uint32_t rgb565_dither(uint32_t threshold)
+{
+    return (threshold >> 1) << 16 | (threshold >> 2) << 8 | (threshold >> 1);
+}
+
+static inline uint16_t pack_rgb565(uint32_t pixel, uint32_t dither)
+{
+    uint32_t r = ((pixel >> 16) & 0xff) + ((dither >> 16) & 0xff);
+    uint32_t g = ((pixel >> 8) & 0xff) + ((dither >> 8) & 0xff);
+    uint32_t b = (pixel & 0xff) + (dither & 0xff);
+    r = r > 255 ? 255 : r;
+    g = g > 255 ? 255 : g;
+    b = b > 255 ? 255 : b;
+    return (uint16_t) ((r >> 3) << 11 | (g >> 2) << 5 | (b >> 3));
+}
+
+#ifdef __SSE2__
+static inline __m128i pack_rgb565_quad(__m128i pixels, __m128i dither)
+{
+    __m128i p = _mm_adds_epu8(pixels, dither);
+    __m128i r = _mm_and_si128(_mm_srli_epi32(p, 8), _mm_set1_epi32(0xf800));
+    __m128i g = _mm_and_si128(_mm_srli_epi32(p, 5), _mm_set1_epi32(0x07e0));
+    __m128i b = _mm_and_si128(_mm_srli_epi32(p, 3), _mm_set1_epi32(0x001f));
+    __m128i v = _mm_or_si128(_mm_or_si128(r, g), b);
+    /* sign-extended, so the signed pack keeps all sixteen bits */
+    return _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+}
+#elif defined(__ARM_NEON)
+static inline uint16x4_t pack_rgb565_quad(uint32x4_t pixels, uint32x4_t dither)
+{
+    uint32x4_t p = vreinterpretq_u32_u8(vqaddq_u8(vreinterpretq_u8_u32(pixels), vreinterpretq_u8_u32(dither)));
+    uint32x4_t r = vandq_u32(vshrq_n_u32(p, 8), vdupq_n_u32(0xf800));
+    uint32x4_t g = vandq_u32(vshrq_n_u32(p, 5), vdupq_n_u32(0x07e0));
+    uint32x4_t b = vandq_u32(vshrq_n_u32(p, 3), vdupq_n_u32(0x001f));
+    return vmovn_u32(vorrq_u32(vorrq_u32(r, g), b));
+}
+#endif
+
+void convert_rgb565(uint16_t *dst, int32_t dst_stride, const uint32_t *src, int32_t src_stride,
+                    const rect &area)
+{
+    for (int32_t y = 0; y < area.height; y++) {
+        uint16_t *d = dst + (area.y + y) * dst_stride + area.x;
+        const uint32_t *s = src + (area.y + y) * src_stride + area.x;
+        const uint8_t *thresholds = bayer4[(area.y + y) & 3];
+        int32_t x = 0;
+#ifdef __SSE2__
+        /* steps of eight keep every lane at the same column phase */
+        __m128i dither = _mm_setr_epi32((int32_t) rgb565_dither(thresholds[area.x & 3]),
+                                        (int32_t) rgb565_dither(thresholds[(area.x + 1) & 3]),
+                                        (int32_t) rgb565_dither(thresholds[(area.x + 2) & 3]),
+                                        (int32_t) rgb565_dither(thresholds[(area.x + 3) & 3]));
+        for (; x + 8 <= area.width; x += 8) {
+            __m128i lo = pack_rgb565_quad(_mm_loadu_si128((const __m128i *) (s + x)), dither);
+            __m128i hi = pack_rgb565_quad(_mm_loadu_si128((const __m128i *) (s + x + 4)), dither);
+            _mm_storeu_si128((__m128i *) (d + x), _mm_packs_epi32(lo, hi));
+        }
+#elif defined(__ARM_NEON)
+        const uint32_t phases[4] = {
+            rgb565_dither(thresholds[area.x & 3]),
+            rgb565_dither(thresholds[(area.x + 1) & 3]),
+            rgb565_dither(thresholds[(area.x + 2) & 3]),
+            rgb565_dither(thresholds[(area.x + 3) & 3])
+        };
+        uint32x4_t dither = vld1q_u32(phases);
+        for (; x + 8 <= area.width; x += 8) {
+            uint16x4_t lo = pack_rgb565_quad(vld1q_u32(s + x), dither);
+            uint16x4_t hi = pack_rgb565_quad(vld1q_u32(s + x + 4), dither);
+            vst1q_u16(d + x, vcombine_u16(lo, hi));
+        }
+#endif
+        for (; x < area.width; x++)
+            d[x] = pack_rgb565(s[x], rgb565_dither(thresholds[(area.x + x) & 3]));
+    }
+}
+
+void blit_scaled(uint32_t *dst, int32_t dst_stride, const rect &area, const rect &target,
+                 const uint32_t *src, int32_t src_stride, int32_t src_width, int32_t src_height)
+{
+    if (rect_empty(target))
+        return;
+
+    /* 16.16 fixed point source steps */
+    int64_t step_x = ((int64_t) src_width << 16) / target.width;
+    int64_t step_y = ((int64_t) src_height << 16) / target.height;
+
+    for (int32_t y = 0; y < area.height; y++) {
+        int64_t sy = ((area.y + y - target.y) * step_y) >> 16;
+        const uint32_t *s = src + sy * src_stride;
+        uint32_t *d = dst + (area.y + y) * dst_stride + area.x;
+
+        int64_t sx = (area.x - target.x) * step_x;
+        for (int32_t x = 0; x < area.width; x++, sx += step_x)
+            d[x] = s[sx >> 16];
+    }
+}
+
+/* filter weights are 2.14 fixed point */
+#define RESAMPLE_SHIFT 14
+#define RESAMPLE_ONE (1 << RESAMPLE_SHIFT)
+
+struct resample_taps {
+    std::vector<int32_t> start;
+    std::vector<int32_t> count;
+    std::vector<int32_t> offset;
+    std::vector<int32_t> weights;
+};
+
+static void build_taps(int32_t src_size, int32_t dst_size, resample_taps &taps)
+{
+    double scale = (double) src_size / dst_size;
+    double support = scale > 1.0 ? scale : 1.0;
+
+    for (int32_t i = 0; i < dst_size; i++) {
+        double center = (i + 0.5) * scale;
+        int32_t lo = (int32_t) floor(center - support);
+        int32_t hi = (int32_t) ceil(center + support);
+        lo = lo < 0 ? 0 : lo;
+        hi = hi > src_size ? src_size : hi;
+
+        int32_t first = (int32_t) taps.weights.size();
+        int32_t total = 0;
+        int32_t heaviest = first;
+        for (int32_t j = lo; j < hi; j++) {
+            double w = 1.0 - fabs(j + 0.5 - center) / support;
+            int32_t fixed = w > 0 ? (int32_t) (w * RESAMPLE_ONE) : 0;
+            taps.weights.push_back(fixed);
+            total += fixed;
+            if (fixed > taps.weights[heaviest])
+                heaviest = (int32_t) taps.weights.size() - 1;
+        }
+
+        /* normalize, rounding error goes to the center tap */
+        int32_t normalized = 0;
+        for (size_t k = first; k < taps.weights.size(); k++) {
+            taps.weights[k] = total ? (int32_t) (((int64_t) taps.weights[k] * RESAMPLE_ONE) / total) : 0;
+            normalized += taps.weights[k];
+        }
+        if (taps.weights.size() > (size_t) first)
+            taps.weights[heaviest] += RESAMPLE_ONE - normalized;
+
+        taps.start.push_back(lo);
+        taps.count.push_back(hi - lo);
+        taps.offset.push_back(first);
+    }
+}
+
+static inline uint32_t pack_channels(const int32_t *acc)
+{
+    uint32_t pixel = 0;
+    for (int c = 0; c < 4; c++) {
+        int32_t v = (acc[c] + (RESAMPLE_ONE >> 1)) >> RESAMPLE_SHIFT;
+        v = v < 0 ? 0 : (v > 255 ? 255 : v);
+        pixel |= (uint32_t) v << (c * 8);
+    }
+    return pixel;
+}
+
+void resample(uint32_t *dst, int32_t dst_stride, int32_t dst_width, int32_t dst_height,
+              const uint32_t *src, int32_t src_stride, const rect &src_area)
+{
+    if (dst_width <= 0 || dst_height <= 0 || rect_empty(src_area))
+        return;
+
+    resample_taps horizontal, vertical;
+    build_taps(src_area.width, dst_width, horizontal);
+    build_taps(src_area.height, dst_height, vertical);
+
+    /* horizontal pass: every source row of the area, scaled to dst_width */
+    std::vector<uint32_t> columns((size_t) dst_width * src_area.height);
+    for (int32_t y = 0; y < src_area.height; y++) {
+        const uint32_t *s = src + (src_area.y + y) * src_stride + src_area.x;
+        uint32_t *out = columns.data() + (size_t) y * dst_width;
+
+        for (int32_t x = 0; x < dst_width; x++) {
+            int32_t acc[4] = { 0, 0, 0, 0 };
+            const int32_t *w = horizontal.weights.data() + horizontal.offset[x];
+            const uint32_t *p = s + horizontal.start[x];
+            for (int32_t k = 0; k < horizontal.count[x]; k++) {
+                for (int c = 0; c < 4; c++)
+                    acc[c] += (int32_t) ((p[k] >> (c * 8)) & 0xff) * w[k];
+            }
+            out[x] = pack_channels(acc);
+        }
+    }
+
+    /* vertical pass: weighted sums of whole rows */
+    std::vector<int32_t> acc((size_t) dst_width * 4);
+    for (int32_t y = 0; y < dst_height; y++) {
+        memset(acc.data(), 0, acc.size() * sizeof(int32_t));
+        const int32_t *w = vertical.weights.data() + vertical.offset[y];
+
+        for (int32_t k = 0; k < vertical.count[y]; k++) {
+            const uint8_t *row = (const uint8_t *) (columns.data() + (size_t) (vertical.start[y] + k) * dst_width);
+            int32_t weight = w[k];
+            int32_t *a = acc.data();
+            for (int32_t i = 0; i < dst_width * 4; i++)
+                a[i] += row[i] * weight;
+        }
+
+        /* bytes in memory order, like they were read */
+        uint8_t *out = (uint8_t *) (dst + y * dst_stride);
+        for (int32_t i = 0; i < dst_width * 4; i++) {
+            int32_t v = (acc[i] + (RESAMPLE_ONE >> 1)) >> RESAMPLE_SHIFT;
+            out[i] = (uint8_t) (v > 255 ? 255 : v);
+        }
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef PIXEL_KERNELS_H
+#define PIXEL_KERNELS_H
+
+#include <stdint.h>
+#include "Geometry.h"
+
+/*
+ * Software rendering kernels for XRGB8888 / ARGB8888 buffers. Strides
+ * are in pixels and every rect must already be clipped to the target.
+ */
+
+void fill_rect(uint32_t *dst, int32_t dst_stride, const rect &area, uint32_t color);
+
+/* copies src (at src_x, src_y) into area of dst */
+void blit(uint32_t *dst, int32_t dst_stride, const rect &area,
+          const uint32_t *src, int32_t src_stride, int32_t src_x, int32_t src_y);
+
+/*
+ * Copies area between two buffers of the same layout with non-temporal
+ * stores on SSE2, so large copies do not evict the cache. Elsewhere,
+ * ARM included, it is a plain memcpy per row.
+ */
+void copy_rect_streaming(uint32_t *dst, const uint32_t *src, int32_t stride, const rect &area);
+
+/* source-over blend of a premultiplied ARGB color into area of dst */
+void blend_color(uint32_t *dst, int32_t dst_stride, const rect &area, uint32_t color);
+
+/* source-over blend of premultiplied ARGB src into area of dst */
+void blend(uint32_t *dst, int32_t dst_stride, const rect &area,
+           const uint32_t *src, int32_t src_stride, int32_t src_x, int32_t src_y);
+
+/*
+ * Source-over blend of a premultiplied ARGB color through an 8-bit
+ * coverage mask (at src_x, src_y), as used for text. Four pixels per
+ * step with SSE2 or NEON, where four uncovered pixels in a row are
+ * skipped.
+ */
+void blend_mask(uint32_t *dst, int32_t dst_stride, const rect &area, uint32_t color,
+                const uint8_t *mask, int32_t mask_stride, int32_t src_x, int32_t src_y);
+
+/*
+ * Interpolates count pixels between from and to at the positions in t
+ * (0 is from, 65535 is to) with six bits of extra precision, which an
+ * ordered dither turns into noise instead of bands. dither holds the
+ * row's eight thresholds (0..63), repeating from dst[0]. Four pixels
+ * per step with SSE2 or NEON.
+ */
+void gradient_span(uint32_t *dst, const uint16_t *t, int32_t count, uint32_t from, uint32_t to,
+                   const uint8_t *dither);
+
+/*
+ * Converts area of XRGB8888 src into RGB565 dst (stride in 16-bit
+ * pixels), with a 4x4 ordered dither tied to the absolute position, so
+ * converting a buffer piece by piece gives the same pixels as at once.
+ * Eight pixels per step with SSE2 or NEON.
+ */
+void convert_rgb565(uint16_t *dst, int32_t dst_stride, const uint32_t *src, int32_t src_stride,
+                    const rect &area);
+
+/*
+ * Nearest-neighbour scaled copy: the source image of src_width x src_height
+ * is stretched over target, only the part inside area is written.
+ */
+void blit_scaled(uint32_t *dst, int32_t dst_stride, const rect &area, const rect &target,
+                 const uint32_t *src, int32_t src_stride, int32_t src_width, int32_t src_height);
+
+/*
+ * Filtered resize of the src_area part of src to dst_width x dst_height,
+ * in two separable passes with a triangle filter widened to the scale
+ * factor, so large reductions average instead of skipping pixels. The
+ * vertical pass runs across whole rows and vectorizes. Meant for
+ * one-off conversions, it allocates an intermediate image.
+ */
+void resample(uint32_t *dst, int32_t dst_stride, int32_t dst_width, int32_t dst_height,
+              const uint32_t *src, int32_t src_stride, const rect &src_area);
+
+#endif /* PIXEL_KERNELS_H */
@@ -0,0 +1,851 @@
+#include "RenderThread.h"
+#include "AllocationCounter.h"
+#include "PixelKernels.h"
+#include "TaskScheduler.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <memory>
+#include <vector>
+
+/* frames after a resize before the allocation check expects a warm path */
+#define STEADY_STATE_FRAMES 3
+
+/*
+ * An identical legacy frame is not committed, so no frame callback
+ * follows; the draw callback is polled again after this long instead,
+ * twice as long after every further identical frame. invalidate()
+ * still redraws at once.
+ */
+#define SKIPPED_FRAME_RETRY_MS 16
+#define SKIPPED_FRAME_RETRY_MAX_MS 1000
+
+static void signal_fd(int fd)
+{
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        fprintf(stderr, "eventfd write failed: %m\n");
+}
+
+static void drain_fd(int fd)
+{
+    uint64_t count;
+    while (read(fd, &count, sizeof(count)) > 0)
+        ;
+}
+
+static void frame_done(void *data, struct wl_callback *callback, uint32_t time)
+{
+    struct client_surface *surface = (struct client_surface *) data;
+
+    struct wl_callback *expected = callback;
+    surface->frameCalback.compare_exchange_strong(expected, nullptr);
+    wl_callback_destroy(callback);
+
+    surface->renderer->render();
+}
+
+static const struct wl_callback_listener frame_listener = {
+    frame_done
+};
+
+static void render_buffer_release(void *data, struct wl_buffer *buffer)
+{
+    struct client_surface *surface = (struct client_surface *) data;
+
+    for (auto client_buffer : surface->content.buffers) {
+        if (client_buffer && client_buffer->buffer == buffer)
+            client_buffer->busy = false;
+    }
+
+    /* a frame was skipped because every buffer was still in use */
+    if (surface->frame_pending)
+        surface->renderer->render();
+}
+
+static const struct wl_buffer_listener render_buffer_listener = {
+    render_buffer_release
+};
+
+static void cached_buffer_release(void *data, struct wl_buffer *buffer)
+{
+    struct client_buffer *client_buffer = (struct client_buffer *) data;
+    client_buffer->busy = false;
+}
+
+static const struct wl_buffer_listener cached_buffer_listener = {
+    cached_buffer_release
+};
+
+RenderThread::RenderThread(struct client_display *display, struct client_surface *surface)
+    : state_cache(StateBufferCache::budget_from_env())
+{
+    this->display = display;
+    this->surface = surface;
+    this->surface_queue = wl_display_create_queue(display->display);
+    this->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    this->done_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (this->wake_fd < 0 || this->done_fd < 0) {
+        fprintf(stderr, "creating render thread eventfds failed: %m\n");
+        exit(1);
+    }
+    this->frame_damage.reserve(MAX_DAMAGE_RECTS + 1);
+    this->damage_mode = damage_mode_from_env();
+    surface->content.buffer_count = swapchain_depth_from_env();
+}
+
+RenderThread::~RenderThread()
+{
+    stop();
+    close(this->wake_fd);
+    close(this->done_fd);
+    /* cached buffers live on the queue, they must go first */
+    this->state_cache.clear();
+    destroy_file_buffer();
+    destroy_snapshot_buffer();
+    wl_event_queue_destroy(this->surface_queue);
+}
+
+void RenderThread::start()
+{
+    this->thread = std::thread(&RenderThread::run, this);
+    pthread_setname_np(this->thread.native_handle(), "hs-surface");
+    fprintf(stderr, "Started render thread for surface %p\n", this->surface->surface);
+}
+
+void RenderThread::stop()
+{
+    if (!this->thread.joinable())
+        return;
+
+    this->stopping = true;
+    signal_fd(this->wake_fd);
+    this->thread.join();
+}
+
+struct wl_event_queue *RenderThread::queue() const
+{
+    return this->surface_queue;
+}
+
+int RenderThread::completion_fd() const
+{
+    return this->done_fd;
+}
+
+void RenderThread::schedule(int32_t width, int32_t height)
+{
+    render_request request = { width, height };
+
+    while (!this->requests.push(request))
+        std::this_thread::yield();
+    signal_fd(this->wake_fd);
+}
+
+void RenderThread::invalidate()
+{
+    schedule(0, 0);
+}
+
+void RenderThread::set_file_image(const struct file_image &image)
+{
+    std::lock_guard<std::mutex> lock(this->file_mutex);
+    this->file = image;
+    this->has_file = true;
+}
+
+void RenderThread::set_snapshot(const std::string &name, bool hold)
+{
+    this->snapshot_name = name;
+    this->snapshot_held = hold;
+}
+
+void RenderThread::release_snapshot()
+{
+    if (this->snapshot_held.exchange(false))
+        schedule(0, 0);
+}
+
+void RenderThread::set_suspended(bool suspended)
+{
+    this->suspend_requested = suspended;
+    schedule(0, 0);
+}
+
+void RenderThread::request_snapshot()
+{
+    this->snapshot_wanted = true;
+    signal_fd(this->wake_fd);
+}
+
+void RenderThread::begin_state_change()
+{
+    this->state_changing = true;
+}
+
+void RenderThread::set_state(uint64_t key)
+{
+    this->state_key = key;
+    this->state_changing = false;
+    schedule(0, 0);
+}
+
+void RenderThread::run()
+{
+    struct wl_display *wl_display = this->display->display;
+    struct pollfd fds[2];
+
+    fds[0].fd = wl_display_get_fd(wl_display);
+    fds[0].events = POLLIN;
+    fds[1].fd = this->wake_fd;
+    fds[1].events = POLLIN;
+
+    while (!this->stopping) {
+        while (wl_display_prepare_read_queue(wl_display, this->surface_queue) != 0) {
+            wl_display_dispatch_queue_pending(wl_display, this->surface_queue);
+            apply_configure();
+        }
+        wl_display_flush(wl_display);
+
+        /* a suspended surface waits for requests only */
+        int timeout = this->suspended ? -1 : this->refine_pending ? 0 :
+                      this->redraw_skipped ? this->redraw_retry_ms : -1;
+        int ready = poll(fds, 2, timeout);
+        if (ready < 0 && errno != EINTR) {
+            wl_display_cancel_read(wl_display);
+            fprintf(stderr, "render thread poll failed: %m\n");
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            if (wl_display_read_events(wl_display) < 0) {
+                fprintf(stderr, "render thread lost the display connection\n");
+                break;
+            }
+        } else {
+            wl_display_cancel_read(wl_display);
+        }
+        wl_display_dispatch_queue_pending(wl_display, this->surface_queue);
+        apply_configure();
+
+        if (fds[1].revents & POLLIN) {
+            drain_fd(this->wake_fd);
+            process_requests();
+            if (this->snapshot_wanted.exchange(false))
+                save_snapshot();
+        }
+
+        if (ready == 0 && !this->suspended && (this->redraw_skipped || this->refine_pending))
+            render();
+    }
+}
+
+void RenderThread::process_requests()
+{
+    render_request request;
+
+    update_suspension();
+
+    while (this->requests.pop(request))
+        configure(request.width, request.height);
+}
+
+void RenderThread::configure_received(uint32_t serial)
+{
+    if (this->configure_pending)
+        this->configures_coalesced++;
+    this->configure_pending = true;
+    this->configure_serial = serial;
+}
+
+void RenderThread::update_suspension()
+{
+    bool suspend = this->suspend_requested.load() || this->toplevel_suspended;
+    if (suspend == this->suspended)
+        return;
+
+    this->suspended = suspend;
+    fprintf(stderr, "%s surface %p\n", suspend ? "Suspending" : "Resuming", this->surface->surface);
+    if (suspend) {
+        release_spare_buffers();
+    } else if (this->full_frame) {
+        /* the compositor may have let go of what it showed, resend all of it once */
+        this->lists[0].reset();
+        this->lists[1].reset();
+    }
+}
+
+/* the acked serial must go out before the commit of the frame drawn for it */
+void RenderThread::apply_configure()
+{
+    if (!this->configure_pending)
+        return;
+    this->configure_pending = false;
+
+    struct client_surface *surface = this->surface;
+    xdg_surface_ack_configure(surface->xdg_surface, this->configure_serial);
+    fprintf(stderr, "Ack configure serial %u for surface %p, %u coalesced so far\n",
+            this->configure_serial, surface->surface, this->configures_coalesced);
+
+    surface->width = surface->configured_width;
+    surface->height = surface->configured_height;
+    if (this->toplevel_suspended && !surface->configured_suspended)
+        this->full_frame = true;
+    this->toplevel_suspended = surface->configured_suspended;
+    update_suspension();
+    configure(surface->width, surface->height);
+}
+
+void RenderThread::configure(int32_t width, int32_t height)
+{
+    if (width == 0 || height == 0) {
+        width = this->surface->buffer_width;
+        height = this->surface->buffer_height;
+    }
+    if (this->surface->buffer_width != width || this->surface->buffer_height != height)
+        resize(width, height);
+    render();
+}
+
+void RenderThread::destroy_buffers()
+{
+    /* the dispatch thread may still hold a completed frame for these buffers */
+    while (this->surface->in_flight.load() > 0 && !this->stopping)
+        std::this_thread::yield();
+
+    for (auto &buffer : this->surface->content.buffers) {
+        if (buffer) {
+            destroy_client_buffer(buffer);
+            buffer = nullptr;
+        }
+    }
+    this->buffer_bytes = 0;
+    this->live_buffers = 0;
+}
+
+/* buffers the compositor does not hold and that do not show the last frame */
+void RenderThread::release_spare_buffers()
+{
+    struct client_content &content = this->surface->content;
+    size_t released = 0;
+
+    for (int32_t i = 0; i < content.buffer_count; i++) {
+        struct client_buffer *&buffer = content.buffers[i];
+        if (!buffer || buffer->busy || buffer == this->last_painted)
+            continue;
+
+        released += buffer->size;
+        this->buffer_bytes -= buffer->size;
+        this->live_buffers--;
+        destroy_client_buffer(buffer);
+        buffer = nullptr;
+    }
+    if (released)
+        fprintf(stderr, "Released %zu KiB of buffers of surface %p\n", released / 1024, this->surface->surface);
+}
+
+/*
+ * Buffers are created on first use: a surface that never draws holds
+ * no shm, and one whose frames are always released in time never gets
+ * past its first buffer. Draw callbacks in diff mode need two, the
+ * frame on screen is what the next one is compared with.
+ */
+struct client_buffer *RenderThread::acquire_buffer()
+{
+    struct client_content &content = this->surface->content;
+    struct client_buffer *keep = !this->surface->scene && this->damage_mode == LEGACY_DAMAGE_DIFF ?
+                                 this->last_painted : nullptr;
+
+    for (int32_t i = 0; i < content.buffer_count; i++) {
+        if (content.buffers[i] && !content.buffers[i]->busy && content.buffers[i] != keep)
+            return content.buffers[i];
+    }
+
+    for (int32_t i = 0; i < content.buffer_count; i++) {
+        if (content.buffers[i])
+            continue;
+
+        int32_t width = this->surface->buffer_width;
+        int32_t height = this->surface->buffer_height;
+        struct client_buffer *&buffer = content.buffers[i];
+        buffer = create_client_buffer(this->display, width, height, this->buffer_format);
+        wl_proxy_set_queue((struct wl_proxy *) buffer->buffer, this->surface_queue);
+        wl_buffer_add_listener(buffer->buffer, &render_buffer_listener, this->surface);
+        buffer->pending_damage.reserve(MAX_DAMAGE_RECTS + 1);
+        buffer->pending_damage.push_back(make_rect(0, 0, width, height));
+
+        this->buffer_bytes += buffer->size;
+        this->live_buffers++;
+        fprintf(stderr, "Buffer %d of %d created for surface %p\n", i + 1, content.buffer_count,
+                this->surface->surface);
+        return buffer;
+    }
+    return nullptr;
+}
+
+void RenderThread::resize(int32_t width, int32_t height)
+{
+    destroy_buffers();
+    this->state_cache.clear();
+    destroy_file_buffer();
+    destroy_snapshot_buffer();
+    this->shown_state = 0;
+    this->last_painted = nullptr;
+    this->tile_hashes.reset(width, height);
+
+    /* draw callbacks write XRGB8888 themselves; buffers and canvas come with the first draw */
+    this->compact = this->surface->scene && this->surface->format == WL_SHM_FORMAT_RGB565;
+    this->buffer_format = this->compact ? WL_SHM_FORMAT_RGB565 : WL_SHM_FORMAT_XRGB8888;
+    std::vector<uint32_t>().swap(this->canvas);
+    this->canvas_damage.clear();
+    this->canvas_bytes = 0;
+    this->cache_bytes = 0;
+
+    this->frames_since_resize = 0;
+    /* an empty previous recording makes the next diff damage everything */
+    this->lists[0].reset();
+    this->lists[1].reset();
+    this->surface->buffer_width = width;
+    this->surface->buffer_height = height;
+    fprintf(stderr, "Surface %p sized %dx%d\n", this->surface->surface, width, height);
+}
+
+void RenderThread::render()
+{
+    struct client_surface *surface = this->surface;
+
+    if (surface->buffer_width <= 0 || this->suspended)
+        return;
+
+    /* time to first pixel: the snapshot goes out before anything is painted */
+    if (surface->scene && !this->snapshot_tried) {
+        this->snapshot_tried = true;
+        if (present_snapshot())
+            return;
+    }
+    if (this->showing_snapshot && this->snapshot_held)
+        return;
+    this->refine_pending = false;
+    if (!this->showing_snapshot && this->snapshot_buffer && !this->snapshot_buffer->busy)
+        destroy_snapshot_buffer();
+
+    /* nothing to draw must not make a busy swapchain grow */
+    if (surface->scene) {
+        std::lock_guard<std::mutex> lock(surface->scene->lock());
+        if (!surface->scene->needs_update(surface->buffer_width, surface->buffer_height) && !this->full_frame)
+            return;
+    }
+
+    client_buffer *next_buffer = acquire_buffer();
+    if (!next_buffer) {
+        surface->frame_pending = true;
+        return;
+    }
+    surface->frame_pending = false;
+    if (this->compact && this->canvas.empty()) {
+        this->canvas.assign((size_t) next_buffer->width * next_buffer->height, 0);
+        this->canvas_bytes = this->canvas.size() * sizeof(uint32_t);
+        this->canvas_damage.reserve(MAX_DAMAGE_RECTS + 1);
+        this->canvas_damage.push_back(make_rect(0, 0, next_buffer->width, next_buffer->height));
+    }
+
+    bool warm = this->frames_since_resize >= STEADY_STATE_FRAMES;
+    completed_frame frame;
+    frame.buffer = next_buffer;
+
+    if (surface->scene) {
+        SceneGraph *scene = surface->scene;
+        std::lock_guard<std::mutex> lock(scene->lock());
+
+        /* checked under the lock, the main thread raises it before its first scene call */
+        if (this->state_changing)
+            return;
+
+        /* shapes new text, which may allocate, so it runs before the check */
+        bool changed = scene->update(next_buffer->width, next_buffer->height);
+        if (!changed && !this->full_frame) {
+            /* nothing changed, let the frame callback chain stop here */
+            return;
+        }
+
+        /*
+         * In test builds, a warmed-up frame must not touch the heap. A
+         * state switch is exempt, it stores the outgoing frame in the cache.
+         */
+        uint64_t state = this->state_key.load();
+        AllocationCheck allocation_check("steady-state frame", warm && state == this->shown_state);
+
+        DisplayList &current = this->lists[this->current_list];
+        DisplayList &previous = this->lists[this->current_list ^ 1];
+        current.reset();
+        scene->record(current);
+
+        this->frame_damage.clear();
+        current.diff(previous, this->frame_damage);
+        this->full_frame = false;
+        this->current_list ^= 1;
+        if (this->frame_damage.empty())
+            return;
+
+        /* other buffers must catch up on this frame's changes when they are reused */
+        for (int32_t i = 0; i < surface->content.buffer_count; i++) {
+            if (surface->content.buffers[i])
+                damage_add_all(surface->content.buffers[i]->pending_damage, this->frame_damage);
+        }
+        if (!this->canvas.empty())
+            damage_add_all(this->canvas_damage, this->frame_damage);
+
+        /*
+         * On a state switch the outgoing state's final frame is kept and
+         * the incoming one is shown from the cache when it was seen before.
+         */
+        struct client_buffer *cached = nullptr;
+        if (state != this->shown_state) {
+            if (this->shown_state && this->last_painted)
+                cache_frame(this->shown_state, this->last_painted);
+            if (state)
+                cached = this->state_cache.find(state, next_buffer->width, next_buffer->height);
+            this->shown_state = state;
+        }
+
+        if (cached) {
+            cached->busy = true;
+            frame.buffer = cached;
+            frame.damage_count = 1;
+            frame.damage[0] = make_rect(0, 0, cached->width, cached->height);
+            this->last_painted = nullptr;
+        } else {
+            current.optimize();
+            struct client_buffer *file = file_buffer_for(current.sole_op(), next_buffer->width, next_buffer->height);
+            if (file) {
+                /* the frame is exactly the file's image, the compositor reads it from there */
+                frame.buffer = file;
+            } else if (!this->canvas.empty()) {
+                /* the canvas holds every frame, the buffer converts whatever it missed */
+                frame.buffer = next_buffer;
+                current.replay(this->canvas.data(), next_buffer->width, this->canvas_damage);
+                this->canvas_damage.clear();
+                for (auto &r : next_buffer->pending_damage)
+                    convert_rgb565((uint16_t *) next_buffer->data, next_buffer->width, this->canvas.data(),
+                                   next_buffer->width, r);
+                next_buffer->pending_damage.clear();
+            } else {
+                frame.buffer = next_buffer;
+                copy_forward(next_buffer);
+                current.replay((uint32_t *) next_buffer->data, next_buffer->width, next_buffer->pending_damage);
+                next_buffer->pending_damage.clear();
+            }
+            frame.buffer->busy = true;
+
+            frame.damage_count = (int32_t) this->frame_damage.size();
+            for (int32_t i = 0; i < frame.damage_count; i++)
+                frame.damage[i] = this->frame_damage[i];
+            this->last_painted = frame.buffer;
+        }
+    } else {
+        AllocationCheck allocation_check("steady-state frame", warm);
+        surface->draw(next_buffer->data, next_buffer->width, next_buffer->height);
+
+        if (!find_legacy_damage(next_buffer)) {
+            /* still static, a surface that stopped animating is polled less and less */
+            if (!this->redraw_skipped)
+                this->redraw_retry_ms = SKIPPED_FRAME_RETRY_MS;
+            else if (this->redraw_retry_ms * 2 <= SKIPPED_FRAME_RETRY_MAX_MS)
+                this->redraw_retry_ms *= 2;
+            this->redraw_skipped = true;
+            return;
+        }
+        this->redraw_skipped = false;
+
+        next_buffer->busy = true;
+        frame.damage_count = (int32_t) this->frame_damage.size();
+        for (int32_t i = 0; i < frame.damage_count; i++)
+            frame.damage[i] = this->frame_damage[i];
+        this->last_painted = next_buffer;
+    }
+
+    this->showing_snapshot = false;
+    this->frames_since_resize++;
+    this->painted_frames++;
+    submit_frame(frame);
+}
+
+void RenderThread::submit_frame(const completed_frame &frame)
+{
+    this->surface->in_flight.fetch_add(1);
+    while (!this->completed.push(frame))
+        std::this_thread::yield();
+    signal_fd(this->done_fd);
+}
+
+/*
+ * Commits the previous run's snapshot straight from its file. The
+ * buffers stay untouched and fully damaged, so the first scene frame
+ * paints everything over it.
+ */
+bool RenderThread::present_snapshot()
+{
+    int32_t width = this->surface->buffer_width;
+    int32_t height = this->surface->buffer_height;
+    if (this->snapshot_name.empty())
+        return false;
+
+    std::string path = FrameSnapshot::path(this->snapshot_name, width, height);
+    if (path.empty() || !this->snapshot.load(path, width, height))
+        return false;
+
+    this->snapshot_buffer = create_file_buffer(this->display, this->snapshot.file());
+    wl_proxy_set_queue((struct wl_proxy *) this->snapshot_buffer->buffer, this->surface_queue);
+    wl_buffer_add_listener(this->snapshot_buffer->buffer, &cached_buffer_listener, this->snapshot_buffer);
+    fprintf(stderr, "Presenting snapshot %s first\n", path.c_str());
+
+    completed_frame frame;
+    frame.buffer = this->snapshot_buffer;
+    frame.buffer->busy = true;
+    frame.damage_count = 1;
+    frame.damage[0] = make_rect(0, 0, width, height);
+    this->showing_snapshot = true;
+    this->refine_pending = !this->snapshot_held;
+    submit_frame(frame);
+    return true;
+}
+
+void RenderThread::destroy_snapshot_buffer()
+{
+    if (this->snapshot_buffer) {
+        destroy_client_buffer(this->snapshot_buffer);
+        this->snapshot_buffer = nullptr;
+    }
+    this->snapshot.unmap();
+    this->showing_snapshot = false;
+}
+
+/*
+ * Copies the frame on screen, the buffer may be painted again before
+ * the file is written on a worker.
+ */
+void RenderThread::save_snapshot()
+{
+    if (!this->showing_snapshot && this->snapshot_buffer && !this->snapshot_buffer->busy)
+        destroy_snapshot_buffer();
+
+    struct client_buffer *frame = this->last_painted;
+    if (this->snapshot_name.empty() || !frame || this->showing_snapshot ||
+        this->painted_frames == this->saved_frames)
+        return;
+
+    std::string path = FrameSnapshot::path(this->snapshot_name, frame->width, frame->height);
+    if (path.empty())
+        return;
+
+    /* a compact frame is saved from the canvas, which is current right after painting */
+    const uint32_t *pixels = (const uint32_t *) frame->data;
+    if (frame->format == WL_SHM_FORMAT_RGB565) {
+        if (this->canvas.empty() || !this->canvas_damage.empty())
+            return;
+        pixels = this->canvas.data();
+    }
+    std::shared_ptr<std::vector<uint32_t>> copy =
+        std::make_shared<std::vector<uint32_t>>(pixels, pixels + (size_t) frame->width * frame->height);
+    int32_t width = frame->width;
+    int32_t height = frame->height;
+    this->display->scheduler->submit([path, copy, width, height]() {
+        FrameSnapshot::save(path, copy->data(), width, height);
+    }, TASK_PRIORITY_LOW);
+    this->saved_frames = this->painted_frames;
+}
+
+/*
+ * Brings buffer up to date with the previous frame by copying what it
+ * missed from the buffer that frame was painted into, which is cheaper
+ * than replaying blends and scaled images there. Afterwards only this
+ * frame's damage is left to replay. Without such a buffer (first frame,
+ * or the previous frame came from the state cache) everything pending
+ * is replayed instead.
+ */
+void RenderThread::copy_forward(struct client_buffer *buffer)
+{
+    struct client_buffer *source = this->last_painted;
+    if (!source || source == buffer || source->width != buffer->width || source->height != buffer->height)
+        return;
+
+    for (auto &r : buffer->pending_damage) {
+        bool repainted = false;
+        for (auto &d : this->frame_damage) {
+            if (rect_contains(d, r)) {
+                repainted = true;
+                break;
+            }
+        }
+        if (!repainted)
+            copy_rect_streaming((uint32_t *) buffer->data, (const uint32_t *) source->data, buffer->width, r);
+    }
+
+    buffer->pending_damage.clear();
+    damage_add_all(buffer->pending_damage, this->frame_damage);
+}
+
+struct client_buffer *RenderThread::file_buffer_for(const draw_op *op, int32_t width, int32_t height)
+{
+    if (!op || op->type != DRAW_OP_BLIT)
+        return nullptr;
+
+    struct file_image image;
+    {
+        std::lock_guard<std::mutex> lock(this->file_mutex);
+        /* without a file descriptor the image is painted like any other */
+        if (!this->has_file || this->file.fd < 0)
+            return nullptr;
+        image = this->file;
+    }
+
+    if (op->src != image.pixels || op->src_x != 0 || op->src_y != 0 ||
+        op->src_stride * 4 != image.stride ||
+        op->area.x != 0 || op->area.y != 0 || op->area.width != width || op->area.height != height ||
+        image.width != width || image.height != height)
+        return nullptr;
+
+    if (this->file_buffer && this->file_buffer->data != image.pixels) {
+        if (this->file_buffer->busy)
+            return nullptr;
+        destroy_file_buffer();
+    }
+
+    if (!this->file_buffer) {
+        this->file_buffer = create_file_buffer(this->display, image);
+        wl_proxy_set_queue((struct wl_proxy *) this->file_buffer->buffer, this->surface_queue);
+        wl_buffer_add_listener(this->file_buffer->buffer, &cached_buffer_listener, this->file_buffer);
+        fprintf(stderr, "Presenting surface %p straight from file\n", this->surface->surface);
+    }
+
+    /* still on screen from an earlier frame, paint a copy instead */
+    if (this->file_buffer->busy)
+        return nullptr;
+    return this->file_buffer;
+}
+
+void RenderThread::destroy_file_buffer()
+{
+    if (this->file_buffer) {
+        destroy_client_buffer(this->file_buffer);
+        this->file_buffer = nullptr;
+    }
+}
+
+/*
+ * The draw callback repainted all of buffer; finds what differs from the
+ * frame on screen. Returns false when nothing does.
+ */
+bool RenderThread::find_legacy_damage(struct client_buffer *buffer)
+{
+    struct client_buffer *previous = this->last_painted;
+    this->frame_damage.clear();
+
+    switch (this->damage_mode) {
+    case LEGACY_DAMAGE_TILES:
+        return this->tile_hashes.compare((uint32_t *) buffer->data, buffer->width, this->frame_damage);
+    case LEGACY_DAMAGE_DIFF:
+        if (previous && previous != buffer) {
+            return diff_buffers((uint32_t *) buffer->data, (uint32_t *) previous->data, buffer->width,
+                                buffer->width, buffer->height, this->frame_damage);
+        }
+        break;
+    case LEGACY_DAMAGE_FULL:
+        break;
+    }
+
+    this->frame_damage.push_back(make_rect(0, 0, buffer->width, buffer->height));
+    return true;
+}
+
+int32_t RenderThread::swapchain_depth_from_env()
+{
+    const char *value = getenv("HOMESCREEN_SWAPCHAIN_BUFFERS");
+    if (!value)
+        return 2;
+
+    int32_t depth = atoi(value);
+    if (depth < 2)
+        depth = 2;
+    if (depth > MAX_SWAPCHAIN_BUFFERS)
+        depth = MAX_SWAPCHAIN_BUFFERS;
+    return depth;
+}
+
+legacy_damage_mode RenderThread::damage_mode_from_env()
+{
+    const char *mode = getenv("HOMESCREEN_LEGACY_DAMAGE");
+
+    /* diff by default, hashing tiles costs more than the upload it saves (see damage-bench) */
+    if (!mode || strcmp(mode, "diff") == 0)
+        return LEGACY_DAMAGE_DIFF;
+    if (strcmp(mode, "tiles") == 0)
+        return LEGACY_DAMAGE_TILES;
+    if (strcmp(mode, "full") == 0)
+        return LEGACY_DAMAGE_FULL;
+
+    fprintf(stderr, "unknown HOMESCREEN_LEGACY_DAMAGE mode '%s', using diff\n", mode);
+    return LEGACY_DAMAGE_DIFF;
+}
+
+void RenderThread::cache_frame(uint64_t key, struct client_buffer *frame)
+{
+    struct client_buffer *buffer = this->state_cache.store(this->display, key, frame);
+    this->cache_bytes = this->state_cache.used();
+    if (!buffer)
+        return;
+
+    wl_proxy_set_queue((struct wl_proxy *) buffer->buffer, this->surface_queue);
+    wl_buffer_add_listener(buffer->buffer, &cached_buffer_listener, buffer);
+}
+
+void RenderThread::dump_memory(FILE *out) const
+{
+    fprintf(out, "surface %p: %d/%d buffers, %zu KiB shm, %zu KiB cached states, %zu KiB canvas\n",
+            this->surface->surface, this->live_buffers.load(), this->surface->content.buffer_count,
+            this->buffer_bytes.load() / 1024, this->cache_bytes.load() / 1024,
+            this->canvas_bytes.load() / 1024);
+}
+
+void RenderThread::present_completed()
+{
+    struct client_surface *surface = this->surface;
+    completed_frame frame;
+
+    /* damage is found in buffer pixels, say so where the compositor understands it */
+    bool damage_buffer = wl_proxy_get_version((struct wl_proxy *) surface->surface) >=
+                         WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION;
+
+    drain_fd(this->done_fd);
+    while (this->completed.pop(frame)) {
+        struct client_buffer *buffer = frame.buffer;
+
+        wl_surface_attach(surface->surface, buffer->buffer, 0, 0);
+        for (int32_t i = 0; i < frame.damage_count; i++) {
+            const rect &r = frame.damage[i];
+            if (damage_buffer)
+                wl_surface_damage_buffer(surface->surface, r.x, r.y, r.width, r.height);
+            else
+                wl_surface_damage(surface->surface, r.x, r.y, r.width, r.height);
+        }
+
+        /*
+         * The callback inherits the surface's queue, so done is delivered
+         * to the surface thread. At most one callback is outstanding,
+         * extra frames (e.g. from a configure) must not multiply the
+         * frame rate.
+         */
+        if (!surface->frameCalback.load()) {
+            struct wl_callback *callback = wl_surface_frame(surface->surface);
+            wl_callback_add_listener(callback, &frame_listener, surface);
+            surface->frameCalback = callback;
+        }
+
+        wl_surface_commit(surface->surface);
+        surface->in_flight.fetch_sub(1);
+    }
+}
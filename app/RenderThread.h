@@ -0,0 +1,222 @@
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "ExampleScene.h"
+#include "SpscRing.h"
+#include "DisplayList.h"
+#include "StateBufferCache.h"
+#include "TileHash.h"
+#include "BufferDiff.h"
+#include "FrameSnapshot.h"
+
+struct render_request {
+    int32_t width;
+    int32_t height;
+};
+
+/* how damage is found for draw callbacks, which cannot report it */
+enum legacy_damage_mode {
+    LEGACY_DAMAGE_TILES,    /* per-tile hashes against the frame on screen */
+    LEGACY_DAMAGE_DIFF,     /* exact row diff against the buffer on screen */
+    LEGACY_DAMAGE_FULL      /* always the whole buffer */
+};
+
+struct completed_frame {
+    struct client_buffer *buffer;
+    int32_t damage_count;
+    rect damage[MAX_DAMAGE_RECTS];
+};
+
+/*
+ * Owns the event queue of one surface and the thread dispatching it.
+ * The wl_surface, xdg_surface, xdg_toplevel, frame callback and buffer
+ * proxies of the surface all live on that queue, so configures and
+ * frame callbacks of one surface never wait behind another surface's
+ * draw. Every thread reads the shared display fd through the
+ * prepare_read protocol.
+ *
+ * Finished buffers travel back through a lock-free ring and are
+ * attached and committed by the main dispatch thread.
+ */
+class RenderThread
+{
+public:
+    RenderThread(struct client_display *display, struct client_surface *surface);
+    ~RenderThread();
+
+    void start();
+    void stop();
+
+    struct wl_event_queue *queue() const;
+
+    /* main thread: ask for a redraw at the given size */
+    void schedule(int32_t width, int32_t height);
+
+    /* main thread: ask for a redraw after the surface's scene changed */
+    void invalidate();
+
+    /*
+     * main thread: the scene is about to change to another content state.
+     * Nothing is painted until set_state(), so no frame mixes the two.
+     */
+    void begin_state_change();
+
+    /*
+     * main thread: the scene now shows the content state named by key.
+     * The last frame of every state is cached and shown again without
+     * repainting when the state returns; 0 means the content is not
+     * cacheable.
+     */
+    void set_state(uint64_t key);
+
+    /*
+     * main thread: frames that consist of nothing but this image, placed
+     * over the whole surface, are presented from its file without a copy
+     */
+    void set_file_image(const struct file_image &image);
+
+    /*
+     * main thread, before start(): the first frame is the snapshot the
+     * previous run saved under name, committed before the scene is
+     * painted. With hold, the scene replaces it only after
+     * release_snapshot(), so content still loading does not flash.
+     */
+    void set_snapshot(const std::string &name, bool hold);
+    void release_snapshot();
+
+    /*
+     * main thread: a suspended surface is covered, it draws nothing and
+     * so requests no frame callbacks, and gives back every buffer but
+     * the one on screen. Resuming draws whatever changed meanwhile.
+     */
+    void set_suspended(bool suspended);
+
+    /* main thread: save the frame on screen as the next boot's snapshot, if it changed */
+    void request_snapshot();
+
+    /* main thread: readable whenever completed frames are waiting */
+    int completion_fd() const;
+
+    /* main thread: attach, damage and commit every completed frame */
+    void present_completed();
+
+    /* any thread: shm and memory this surface holds right now */
+    void dump_memory(FILE *out) const;
+
+    /* surface thread only, called from the surface's listeners */
+    void configure(int32_t width, int32_t height);
+    void render();
+    /*
+     * An xdg_surface configure ended a sequence. Configures dispatched
+     * in the same batch are coalesced: only the latest serial is acked
+     * and the buffers are reallocated only if its size differs.
+     */
+    void configure_received(uint32_t serial);
+
+private:
+    struct client_display *display;
+    struct client_surface *surface;
+    struct wl_event_queue *surface_queue;
+    std::thread thread;
+    std::atomic<bool> stopping{false};
+
+    int wake_fd;
+    int done_fd;
+    SpscRing<render_request, 16> requests;
+    SpscRing<completed_frame, 16> completed;
+    std::vector<rect> frame_damage;
+    /* this frame's and the previous frame's recording, swapped every frame */
+    DisplayList lists[2];
+    int current_list = 0;
+    /* frames drawn since the buffers were (re)allocated */
+    int32_t frames_since_resize = 0;
+    std::atomic<uint64_t> state_key{0};
+    std::atomic<bool> state_changing{false};
+    StateBufferCache state_cache;
+    /* legacy draw frames are compared to the one on screen */
+    legacy_damage_mode damage_mode;
+    FrameTileHashes tile_hashes;
+    /* the last legacy frame was identical and skipped, poll draw again later */
+    bool redraw_skipped = false;
+    int32_t redraw_retry_ms = 0;
+    /* suspended by the main thread or by the compositor's toplevel state */
+    std::atomic<bool> suspend_requested{false};
+    bool toplevel_suspended = false;
+    bool suspended = false;
+    /* the next frame repaints and damages everything, even if the scene did not change */
+    bool full_frame = false;
+
+    /* xdg_surface configure waiting for the end of the dispatch batch */
+    bool configure_pending = false;
+    uint32_t configure_serial = 0;
+    uint32_t configures_coalesced = 0;
+    /* state of the frame on screen and the buffer it was painted into, if any */
+    uint64_t shown_state = 0;
+    struct client_buffer *last_painted = nullptr;
+    /*
+     * Surfaces in a compact format render here, in XRGB8888, and convert
+     * what each buffer missed; canvas_damage is what the canvas missed
+     */
+    std::vector<uint32_t> canvas;
+    std::vector<rect> canvas_damage;
+    bool compact = false;
+    uint32_t buffer_format = WL_SHM_FORMAT_XRGB8888;
+
+    /* for dump_memory(), written by the surface thread */
+    std::atomic<int32_t> live_buffers{0};
+    std::atomic<size_t> buffer_bytes{0};
+    std::atomic<size_t> cache_bytes{0};
+    std::atomic<size_t> canvas_bytes{0};
+
+    std::mutex file_mutex;
+    struct file_image file = {};
+    bool has_file = false;
+    /* surface thread: the wl_buffer made from file */
+    struct client_buffer *file_buffer = nullptr;
+
+    /* boot snapshot, see set_snapshot() */
+    std::string snapshot_name;
+    std::atomic<bool> snapshot_held{false};
+    std::atomic<bool> snapshot_wanted{false};
+    FrameSnapshot snapshot;
+    struct client_buffer *snapshot_buffer = nullptr;
+    bool snapshot_tried = false;
+    bool showing_snapshot = false;
+    /* the snapshot is up, paint the scene without waiting for a frame callback */
+    bool refine_pending = false;
+    /* frames painted from the scene, and how many there were at the last save */
+    uint64_t painted_frames = 0;
+    uint64_t saved_frames = 0;
+
+    void run();
+    void process_requests();
+    void apply_configure();
+    void resize(int32_t width, int32_t height);
+    void destroy_buffers();
+    struct client_buffer *acquire_buffer();
+    void release_spare_buffers();
+    void update_suspension();
+    void cache_frame(uint64_t key, struct client_buffer *frame);
+    bool find_legacy_damage(struct client_buffer *buffer);
+
+    void copy_forward(struct client_buffer *buffer);
+    struct client_buffer *file_buffer_for(const draw_op *op, int32_t width, int32_t height);
+    void destroy_file_buffer();
+    bool present_snapshot();
+    void destroy_snapshot_buffer();
+    void save_snapshot();
+    void submit_frame(const completed_frame &frame);
+
+    /* HOMESCREEN_LEGACY_DAMAGE: diff (default), tiles or full */
+    static legacy_damage_mode damage_mode_from_env();
+    /* HOMESCREEN_SWAPCHAIN_BUFFERS: 2 up to MAX_SWAPCHAIN_BUFFERS */
+    static int32_t swapchain_depth_from_env();
+};
+
+#endif /* RENDER_THREAD_H */
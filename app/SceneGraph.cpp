@@ -0,0 +1,344 @@
+#include "SceneGraph.h"
+#include <math.h>
+#include <algorithm>
+
+SceneGraph::SceneGraph(uint32_t clear_color)
+{
+    this->clear_color = clear_color;
+    this->text_renderer = nullptr;
+    this->surface_width = 0;
+    this->surface_height = 0;
+    this->dirty = true;
+    this->updates = 0;
+    add_node(-1, SCENE_NODE_GROUP, 0, 0);
+}
+
+std::mutex &SceneGraph::lock()
+{
+    return this->mutex;
+}
+
+uint64_t SceneGraph::update_count()
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->updates;
+}
+
+scene_node_id SceneGraph::add_node(scene_node_id parent, scene_node_type type, float x, float y)
+{
+    scene_node node;
+    node.type = type;
+    node.flags = SCENE_NODE_VISIBLE | SCENE_NODE_DIRTY_TRANSFORM | SCENE_NODE_DIRTY_CONTENT;
+    node.parent = parent;
+    node.first_child = -1;
+    node.last_child = -1;
+    node.next_sibling = -1;
+    node.local.scale_x = 1;
+    node.local.scale_y = 1;
+    node.local.x = x;
+    node.local.y = y;
+    node.world = node.local;
+    node.width = 0;
+    node.height = 0;
+    node.color = 0;
+    node.image.pixels = nullptr;
+    node.image.width = 0;
+    node.image.height = 0;
+    node.image.stride = 0;
+    node.image.opaque = false;
+    node.text_size = 0;
+    node.version = 0;
+    node.bounds = make_rect(0, 0, 0, 0);
+
+    scene_node_id id = (scene_node_id) this->nodes.size();
+    this->nodes.push_back(node);
+
+    if (parent >= 0) {
+        scene_node &p = this->nodes[parent];
+        if (p.last_child >= 0)
+            this->nodes[p.last_child].next_sibling = id;
+        else
+            p.first_child = id;
+        p.last_child = id;
+    }
+    this->dirty = true;
+    return id;
+}
+
+scene_node_id SceneGraph::add_group(scene_node_id parent, float x, float y)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return add_node(parent, SCENE_NODE_GROUP, x, y);
+}
+
+scene_node_id SceneGraph::add_rect(scene_node_id parent, const rect &area, uint32_t color)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    scene_node_id id = add_node(parent, SCENE_NODE_RECT, area.x, area.y);
+    this->nodes[id].width = area.width;
+    this->nodes[id].height = area.height;
+    this->nodes[id].color = color;
+    return id;
+}
+
+scene_node_id SceneGraph::add_image(scene_node_id parent, float x, float y, const scene_image &image)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    scene_node_id id = add_node(parent, SCENE_NODE_IMAGE, x, y);
+    this->nodes[id].image = image;
+    this->nodes[id].width = image.width;
+    this->nodes[id].height = image.height;
+    return id;
+}
+
+scene_node_id SceneGraph::add_text(scene_node_id parent, float x, float y, const std::string &text,
+                                   int32_t size, uint32_t color)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    scene_node_id id = add_node(parent, SCENE_NODE_TEXT, x, y);
+    this->nodes[id].text = text;
+    this->nodes[id].text_size = size;
+    this->nodes[id].color = color;
+    return id;
+}
+
+void SceneGraph::mark(scene_node_id id, uint32_t flags)
+{
+    this->nodes[id].flags |= flags;
+    this->dirty = true;
+}
+
+void SceneGraph::set_position(scene_node_id id, float x, float y)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    scene_node &node = this->nodes[id];
+    if (node.local.x == x && node.local.y == y)
+        return;
+    node.local.x = x;
+    node.local.y = y;
+    mark(id, SCENE_NODE_DIRTY_TRANSFORM);
+}
+
+void SceneGraph::set_scale(scene_node_id id, float scale_x, float scale_y)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    scene_node &node = this->nodes[id];
+    if (node.local.scale_x == scale_x && node.local.scale_y == scale_y)
+        return;
+    node.local.scale_x = scale_x;
+    node.local.scale_y = scale_y;
+    mark(id, SCENE_NODE_DIRTY_TRANSFORM);
+}
+
+void SceneGraph::set_size(scene_node_id id, int32_t width, int32_t height)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    scene_node &node = this->nodes[id];
+    if (node.width == width && node.height == height)
+        return;
+    node.width = width;
+    node.height = height;
+    mark(id, SCENE_NODE_DIRTY_CONTENT);
+}
+
+void SceneGraph::set_visible(scene_node_id id, bool visible)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    scene_node &node = this->nodes[id];
+    if (!!(node.flags & SCENE_NODE_VISIBLE) == visible)
+        return;
+    if (visible)
+        node.flags |= SCENE_NODE_VISIBLE;
+    else
+        node.flags &= ~SCENE_NODE_VISIBLE;
+    mark(id, SCENE_NODE_DIRTY_TRANSFORM);
+}
+
+void SceneGraph::set_color(scene_node_id id, uint32_t color)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    scene_node &node = this->nodes[id];
+    if (node.color == color)
+        return;
+    node.color = color;
+    mark(id, SCENE_NODE_DIRTY_CONTENT);
+}
+
+void SceneGraph::set_image(scene_node_id id, const scene_image &image)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    scene_node &node = this->nodes[id];
+    node.image = image;
+    node.width = image.width;
+    node.height = image.height;
+    node.version++;
+    mark(id, SCENE_NODE_DIRTY_CONTENT);
+}
+
+void SceneGraph::set_text(scene_node_id id, const std::string &text)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    scene_node &node = this->nodes[id];
+    if (node.text == text)
+        return;
+    node.text = text;
+    node.version++;
+    mark(id, SCENE_NODE_DIRTY_CONTENT);
+}
+
+void SceneGraph::set_clear_color(uint32_t color)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->clear_color == color)
+        return;
+    this->clear_color = color;
+    this->dirty = true;
+}
+
+void SceneGraph::set_text_renderer(TextRenderer *renderer)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->text_renderer = renderer;
+    for (size_t i = 0; i < this->nodes.size(); i++) {
+        if (this->nodes[i].type == SCENE_NODE_TEXT)
+            mark((scene_node_id) i, SCENE_NODE_DIRTY_CONTENT);
+    }
+}
+
+rect SceneGraph::compute_bounds(const scene_node &node) const
+{
+    if (node.type == SCENE_NODE_GROUP)
+        return make_rect(0, 0, 0, 0);
+
+    const scene_transform &t = node.world;
+    bool unscaled = node.type == SCENE_NODE_TEXT ||
+                    (node.type == SCENE_NODE_IMAGE && t.scale_x == 1 && t.scale_y == 1);
+    if (unscaled) {
+        /* copied 1:1, so snap to whole pixels and keep the source size */
+        int32_t x = (int32_t) floorf(t.x + 0.5f);
+        int32_t y = (int32_t) floorf(t.y + 0.5f);
+        return make_rect(x, y, node.width, node.height);
+    }
+
+    int32_t x1 = (int32_t) floorf(t.x);
+    int32_t y1 = (int32_t) floorf(t.y);
+    int32_t x2 = (int32_t) ceilf(t.x + node.width * t.scale_x);
+    int32_t y2 = (int32_t) ceilf(t.y + node.height * t.scale_y);
+    return make_rect(x1, y1, x2 - x1, y2 - y1);
+}
+
+bool SceneGraph::needs_update(int32_t width, int32_t height) const
+{
+    return this->dirty || width != this->surface_width || height != this->surface_height;
+}
+
+bool SceneGraph::update(int32_t width, int32_t height)
+{
+    if (width != this->surface_width || height != this->surface_height) {
+        this->surface_width = width;
+        this->surface_height = height;
+        this->dirty = true;
+    }
+    if (!this->dirty)
+        return false;
+
+    /* parents precede children, so one forward pass sees final parent state */
+    for (size_t i = 0; i < this->nodes.size(); i++) {
+        scene_node &node = this->nodes[i];
+        bool shown = (node.flags & SCENE_NODE_VISIBLE) != 0;
+
+        if (node.parent >= 0) {
+            const scene_node &parent = this->nodes[node.parent];
+            if (parent.flags & SCENE_NODE_DIRTY_TRANSFORM)
+                node.flags |= SCENE_NODE_DIRTY_TRANSFORM;
+            shown = shown && (parent.flags & SCENE_NODE_SHOWN);
+        }
+        if (shown)
+            node.flags |= SCENE_NODE_SHOWN;
+        else
+            node.flags &= ~SCENE_NODE_SHOWN;
+
+        if (node.flags & SCENE_NODE_DIRTY_TRANSFORM) {
+            if (node.parent >= 0) {
+                const scene_transform &p = this->nodes[node.parent].world;
+                node.world.scale_x = p.scale_x * node.local.scale_x;
+                node.world.scale_y = p.scale_y * node.local.scale_y;
+                node.world.x = p.x + node.local.x * p.scale_x;
+                node.world.y = p.y + node.local.y * p.scale_y;
+            } else {
+                node.world = node.local;
+            }
+        }
+
+        /* shaped here rather than in set_text(), so it happens on the render thread */
+        if (node.type == SCENE_NODE_TEXT && (node.flags & SCENE_NODE_DIRTY_CONTENT)) {
+            node.run = this->text_renderer ? this->text_renderer->shape(node.text, node.text_size) : nullptr;
+            node.width = node.run ? node.run->width : 0;
+            node.height = node.run ? node.run->height : 0;
+        }
+
+        if (node.flags & (SCENE_NODE_DIRTY_TRANSFORM | SCENE_NODE_DIRTY_CONTENT))
+            node.bounds = shown ? compute_bounds(node) : make_rect(0, 0, 0, 0);
+    }
+
+    /* dirty flags are cleared only after children had a chance to see them */
+    for (auto &node : this->nodes)
+        node.flags &= ~(SCENE_NODE_DIRTY_TRANSFORM | SCENE_NODE_DIRTY_CONTENT);
+
+    this->dirty = false;
+    this->updates++;
+    return true;
+}
+
+void SceneGraph::record_node(scene_node_id id, DisplayList &list)
+{
+    const scene_node &node = this->nodes[id];
+    rect area = rect_intersect(node.bounds, make_rect(0, 0, this->surface_width, this->surface_height));
+    if (rect_empty(area))
+        return;
+
+    switch (node.type) {
+    case SCENE_NODE_RECT:
+        list.fill(id, area, node.color);
+        break;
+    case SCENE_NODE_IMAGE:
+        if (node.world.scale_x == 1 && node.world.scale_y == 1)
+            list.blit(id, node.version, area, node.image.pixels, node.image.stride,
+                      area.x - node.bounds.x, area.y - node.bounds.y, node.image.opaque);
+        else
+            list.blit_scaled(id, node.version, area, node.bounds, node.image.pixels, node.image.stride,
+                             node.image.width, node.image.height);
+        break;
+    case SCENE_NODE_TEXT:
+        if (node.run)
+            list.mask(id, node.version, area, node.run->mask.data(), node.run->width,
+                      area.x - node.bounds.x, area.y - node.bounds.y, node.color);
+        break;
+    case SCENE_NODE_GROUP:
+        break;
+    }
+}
+
+void SceneGraph::record(DisplayList &list)
+{
+    list.fill(SCENE_ROOT, make_rect(0, 0, this->surface_width, this->surface_height), this->clear_color);
+
+    /* depth-first in child order gives painter's order */
+    this->stack.clear();
+    this->stack.push_back(SCENE_ROOT);
+    while (!this->stack.empty()) {
+        scene_node_id id = this->stack.back();
+        this->stack.pop_back();
+        const scene_node &node = this->nodes[id];
+        if (!(node.flags & SCENE_NODE_SHOWN))
+            continue;
+
+        record_node(id, list);
+
+        /* push children in reverse so the first child is drawn first */
+        size_t first = this->stack.size();
+        for (scene_node_id child = node.first_child; child >= 0; child = this->nodes[child].next_sibling)
+            this->stack.push_back(child);
+        std::reverse(this->stack.begin() + first, this->stack.end());
+    }
+}
@@ -0,0 +1,145 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Geometry.h"
+#include "DisplayList.h"
+#include "TextRenderer.h"
+
+typedef int32_t scene_node_id;
+
+/* every graph starts with a group at index 0 */
+#define SCENE_ROOT 0
+
+enum scene_node_type {
+    SCENE_NODE_GROUP,
+    SCENE_NODE_RECT,
+    SCENE_NODE_IMAGE,
+    SCENE_NODE_TEXT
+};
+
+enum scene_node_flags {
+    SCENE_NODE_VISIBLE = 1 << 0,
+    SCENE_NODE_DIRTY_TRANSFORM = 1 << 1,  /* moves this node and its subtree */
+    SCENE_NODE_DIRTY_CONTENT = 1 << 2,    /* repaints this node only */
+    SCENE_NODE_SHOWN = 1 << 3             /* visible along with all ancestors */
+};
+
+/* scale followed by translation, relative to the parent */
+struct scene_transform {
+    float scale_x;
+    float scale_y;
+    float x;
+    float y;
+};
+
+/* premultiplied ARGB pixels, owned by the caller */
+struct scene_image {
+    const uint32_t *pixels;
+    int32_t width;
+    int32_t height;
+    int32_t stride;
+    bool opaque;
+};
+
+struct scene_node {
+    scene_node_type type;
+    uint32_t flags;
+    scene_node_id parent;
+    scene_node_id first_child;
+    scene_node_id last_child;
+    scene_node_id next_sibling;
+
+    scene_transform local;
+    scene_transform world;
+    int32_t width;
+    int32_t height;
+
+    uint32_t color;
+    scene_image image;
+    std::string text;
+    int32_t text_size;
+    /* shaped text, gives the node its size; shared with the run cache */
+    std::shared_ptr<const text_run> run;
+    /* bumped whenever image or text content changes */
+    uint32_t version;
+
+    /* surface space bounds */
+    rect bounds;
+};
+
+/*
+ * Retained description of a surface's content. Nodes live in one
+ * contiguous array, a parent always precedes its children, so world
+ * transforms and dirty state propagate in a single forward pass.
+ * Changing a node only marks it dirty; update() reports whether
+ * anything changed and record() turns the shown nodes into a display
+ * list, whose diff against the previous frame is the damage.
+ *
+ * Mutators and the render path take the graph's lock, so content may
+ * be changed from any thread.
+ */
+class SceneGraph
+{
+public:
+    explicit SceneGraph(uint32_t clear_color);
+
+    scene_node_id add_group(scene_node_id parent, float x, float y);
+    scene_node_id add_rect(scene_node_id parent, const rect &area, uint32_t color);
+    scene_node_id add_image(scene_node_id parent, float x, float y, const scene_image &image);
+    /* text is rasterized at size pixels, scale only moves it */
+    scene_node_id add_text(scene_node_id parent, float x, float y, const std::string &text,
+                           int32_t size, uint32_t color);
+
+    void set_position(scene_node_id id, float x, float y);
+    void set_scale(scene_node_id id, float scale_x, float scale_y);
+    void set_size(scene_node_id id, int32_t width, int32_t height);
+    void set_visible(scene_node_id id, bool visible);
+    void set_color(scene_node_id id, uint32_t color);
+    void set_image(scene_node_id id, const scene_image &image);
+    void set_text(scene_node_id id, const std::string &text);
+    void set_clear_color(uint32_t color);
+    /* shapes the text nodes, without one they draw nothing */
+    void set_text_renderer(TextRenderer *renderer);
+
+    /*
+     * Propagates transforms and dirty flags for a surface of the given
+     * size. Returns false when nothing changed. Caller holds lock().
+     */
+    bool update(int32_t width, int32_t height);
+    /* whether update() would report a change, without doing it. Caller holds lock(). */
+    bool needs_update(int32_t width, int32_t height) const;
+
+    /* records the shown nodes in painter's order. Caller holds lock(). */
+    void record(DisplayList &list);
+
+    /*
+     * update() calls that reported a change so far. Once it passes the
+     * count taken after replacing an image, no frame reads the old one.
+     */
+    uint64_t update_count();
+
+    std::mutex &lock();
+
+private:
+    std::mutex mutex;
+    std::vector<scene_node> nodes;
+    std::vector<scene_node_id> stack;
+    uint32_t clear_color;
+    TextRenderer *text_renderer;
+    int32_t surface_width;
+    int32_t surface_height;
+    bool dirty;
+    uint64_t updates;
+
+    scene_node_id add_node(scene_node_id parent, scene_node_type type, float x, float y);
+    void mark(scene_node_id id, uint32_t flags);
+    rect compute_bounds(const scene_node &node) const;
+    void record_node(scene_node_id id, DisplayList &list);
+};
+
+#endif /* SCENE_GRAPH_H */
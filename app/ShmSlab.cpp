@@ -0,0 +1,176 @@
+#include "ShmSlab.h"
+#include "ExampleScene.h"
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* slot sizes, each class four times the previous */
+static const size_t size_classes[] = {
+    16 * 1024,
+    64 * 1024,
+    256 * 1024,
+    1024 * 1024
+};
+#define SIZE_CLASS_COUNT (sizeof(size_classes) / sizeof(size_classes[0]))
+#define SLAB_SIZE (4 * 1024 * 1024)
+
+static int size_class_for(size_t size)
+{
+    for (size_t i = 0; i < SIZE_CLASS_COUNT; i++) {
+        if (size <= size_classes[i])
+            return (int) i;
+    }
+    return -1;
+}
+
+ShmSlabAllocator::ShmSlabAllocator(struct wl_shm *shm) : shm(shm)
+{
+}
+
+ShmSlabAllocator::~ShmSlabAllocator()
+{
+    for (auto slab : this->slabs)
+        destroy_slab(slab);
+}
+
+struct shm_slab *ShmSlabAllocator::create_slab(int size_class)
+{
+    struct shm_slab *slab = new shm_slab();
+    slab->size_class = size_class;
+    slab->slot_size = size_classes[size_class];
+    slab->slot_count = (int32_t) (SLAB_SIZE / slab->slot_size);
+    slab->size = SLAB_SIZE;
+
+    slab->fd = os_create_anonymous_file(slab->size);
+    if (slab->fd < 0) {
+        fprintf(stderr, "creating a slab file for %zu B failed: %m\n", slab->size);
+        exit(1);
+    }
+
+    slab->data = mmap(NULL, slab->size, PROT_READ | PROT_WRITE, MAP_SHARED, slab->fd, 0);
+    if (slab->data == MAP_FAILED) {
+        fprintf(stderr, "mmap of slab failed: %m\n");
+        close(slab->fd);
+        exit(1);
+    }
+
+    /* the fd stays open so compact() can punch out free slots */
+    slab->pool = wl_shm_create_pool(this->shm, slab->fd, slab->size);
+
+    /* hand out low slots first, they are popped from the back */
+    slab->free_slots.reserve(slab->slot_count);
+    for (int32_t slot = slab->slot_count - 1; slot >= 0; slot--)
+        slab->free_slots.push_back(slot);
+    slab->punched.assign(slab->slot_count, false);
+
+    this->slabs.push_back(slab);
+    fprintf(stderr, "Created shm slab of %d x %zu B\n", slab->slot_count, slab->slot_size);
+    return slab;
+}
+
+void ShmSlabAllocator::destroy_slab(struct shm_slab *slab)
+{
+    wl_shm_pool_destroy(slab->pool);
+    munmap(slab->data, slab->size);
+    close(slab->fd);
+    delete slab;
+}
+
+bool ShmSlabAllocator::allocate(struct client_buffer *buffer, int32_t width, int32_t height,
+                                int32_t stride, uint32_t format)
+{
+    size_t size = (size_t) stride * height;
+    int size_class = size_class_for(size);
+    if (size_class < 0)
+        return false;
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    struct shm_slab *slab = nullptr;
+    for (auto candidate : this->slabs) {
+        if (candidate->size_class == size_class && !candidate->free_slots.empty()) {
+            slab = candidate;
+            break;
+        }
+    }
+    if (!slab)
+        slab = create_slab(size_class);
+
+    int32_t slot = slab->free_slots.back();
+    slab->free_slots.pop_back();
+    slab->punched[slot] = false;
+
+    int32_t offset = (int32_t) (slot * slab->slot_size);
+    buffer->buffer = wl_shm_pool_create_buffer(slab->pool, offset, width, height, stride, format);
+    buffer->data = (uint8_t *) slab->data + offset;
+    buffer->width = width;
+    buffer->height = height;
+    buffer->size = size;
+    buffer->allocator = this;
+    buffer->slab = slab;
+    buffer->slot = slot;
+    return true;
+}
+
+void ShmSlabAllocator::release(struct client_buffer *buffer)
+{
+    if (buffer->buffer)
+        wl_buffer_destroy(buffer->buffer);
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    buffer->slab->free_slots.push_back(buffer->slot);
+    buffer->buffer = nullptr;
+    buffer->data = nullptr;
+    buffer->slab = nullptr;
+    buffer->allocator = nullptr;
+}
+
+void ShmSlabAllocator::compact()
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    size_t returned = 0;
+
+    for (size_t i = 0; i < this->slabs.size();) {
+        struct shm_slab *slab = this->slabs[i];
+
+        if ((int32_t) slab->free_slots.size() == slab->slot_count) {
+            returned += slab->size;
+            destroy_slab(slab);
+            this->slabs.erase(this->slabs.begin() + i);
+            continue;
+        }
+
+        /*
+         * Live buffers are never moved: the compositor may be reading
+         * them and their owners hold the mapping. Free slots give their
+         * pages back instead and read as zero when handed out again.
+         */
+        for (auto slot : slab->free_slots) {
+            if (slab->punched[slot])
+                continue;
+            if (fallocate(slab->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                          (off_t) slot * slab->slot_size, slab->slot_size) == 0) {
+                slab->punched[slot] = true;
+                returned += slab->slot_size;
+            }
+        }
+        i++;
+    }
+
+    if (returned)
+        fprintf(stderr, "shm slabs: compaction returned %zu KiB\n", returned / 1024);
+}
+
+void ShmSlabAllocator::dump_stats(FILE *out)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    fprintf(out, "shm slabs: %zu\n", this->slabs.size());
+    for (auto slab : this->slabs) {
+        fprintf(out, "  class %zu KiB: %d/%d slots live\n",
+                slab->slot_size / 1024,
+                slab->slot_count - (int32_t) slab->free_slots.size(),
+                slab->slot_count);
+    }
+}
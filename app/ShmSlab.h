@@ -0,0 +1,60 @@
+#ifndef SHM_SLAB_H
+#define SHM_SLAB_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+#include <wayland-client.h>
+
+struct client_buffer;
+
+/* one shared file and wl_shm_pool cut into equal slots */
+struct shm_slab {
+    int size_class;
+    size_t slot_size;
+    int32_t slot_count;
+    int fd;
+    void *data;
+    size_t size;
+    struct wl_shm_pool *pool;
+    std::vector<int32_t> free_slots;
+    /* free slots whose pages were already returned to the system */
+    std::vector<bool> punched;
+};
+
+/*
+ * Packs small buffers (icons, widget content) into a few large shm
+ * pools. Each slab is one file, one mapping and one wl_shm_pool divided
+ * into equal slots of a size class; buffers are wl_buffers created at
+ * slot offsets. Buffers larger than the biggest class are not handled
+ * here and get a dedicated pool from create_client_buffer().
+ *
+ * compact() is meant for idle time: it drops slabs that became empty
+ * and punches the pages of free slots out of the remaining files, so
+ * memory follows the live widget count while fds and mappings stay few.
+ */
+class ShmSlabAllocator
+{
+public:
+    explicit ShmSlabAllocator(struct wl_shm *shm);
+    ~ShmSlabAllocator();
+
+    /* fills in buffer, false when it is too large for any size class */
+    bool allocate(struct client_buffer *buffer, int32_t width, int32_t height,
+                  int32_t stride, uint32_t format);
+    void release(struct client_buffer *buffer);
+
+    void compact();
+    void dump_stats(FILE *out);
+
+private:
+    struct wl_shm *shm;
+    std::mutex mutex;
+    std::vector<struct shm_slab *> slabs;
+
+    struct shm_slab *create_slab(int size_class);
+    void destroy_slab(struct shm_slab *slab);
+};
+
+#endif /* SHM_SLAB_H */
@@ -0,0 +1,57 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stddef.h>
+#include <atomic>
+
+/*
+ * Bounded lock-free ring for exactly one producer thread and one
+ * consumer thread. Capacity must be a power of two.
+ */
+template <typename T, size_t Capacity>
+class SpscRing
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    SpscRing() : head(0), tail(0) {}
+
+    /* producer side, returns false when the ring is full */
+    bool push(const T &item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == Capacity)
+            return false;
+
+        slots[t & (Capacity - 1)] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* consumer side, returns false when the ring is empty */
+    bool pop(T &item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+
+        item = slots[h & (Capacity - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+private:
+    /*
+     * Padding keeps the indices on separate cache lines to avoid false
+     * sharing; alignas would need C++17 aligned new for heap instances.
+     */
+    std::atomic<size_t> head;
+    char head_pad[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail;
+    char tail_pad[64 - sizeof(std::atomic<size_t>)];
+    T slots[Capacity];
+};
+
+#endif /* SPSC_RING_H */
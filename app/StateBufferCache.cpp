@@ -0,0 +1,109 @@
+#include "StateBufferCache.h"
+#include "ExampleScene.h"
+#include <stdlib.h>
+
+#define DEFAULT_STATE_CACHE_KB (16 * 1024)
+
+StateBufferCache::StateBufferCache(size_t budget)
+{
+    this->budget = budget;
+    this->bytes = 0;
+    this->tick = 0;
+    this->entries.reserve(MAX_STATE_VARIANTS);
+}
+
+StateBufferCache::~StateBufferCache()
+{
+    clear();
+}
+
+struct client_buffer *StateBufferCache::find(uint64_t key, int32_t width, int32_t height)
+{
+    for (auto &e : this->entries) {
+        if (e.key != key)
+            continue;
+        if (e.buffer->width != width || e.buffer->height != height || e.buffer->busy)
+            return nullptr;
+        e.last_used = ++this->tick;
+        return e.buffer;
+    }
+    return nullptr;
+}
+
+bool StateBufferCache::evict_one()
+{
+    size_t victim = this->entries.size();
+
+    for (size_t i = 0; i < this->entries.size(); i++) {
+        /* the compositor may still be reading a busy buffer */
+        if (this->entries[i].buffer->busy)
+            continue;
+        if (victim == this->entries.size() || this->entries[i].last_used < this->entries[victim].last_used)
+            victim = i;
+    }
+    if (victim == this->entries.size())
+        return false;
+
+    this->bytes -= this->entries[victim].buffer->size;
+    destroy_client_buffer(this->entries[victim].buffer);
+    this->entries[victim] = this->entries.back();
+    this->entries.pop_back();
+    return true;
+}
+
+struct client_buffer *StateBufferCache::store(struct client_display *display, uint64_t key,
+                                              const struct client_buffer *frame)
+{
+    if (frame->size > this->budget)
+        return nullptr;
+
+    /* a stale entry for the key, e.g. from before a resize */
+    for (size_t i = 0; i < this->entries.size(); i++) {
+        entry &e = this->entries[i];
+        if (e.key != key)
+            continue;
+        if (e.buffer->busy)
+            return nullptr;
+        this->bytes -= e.buffer->size;
+        destroy_client_buffer(e.buffer);
+        e = this->entries.back();
+        this->entries.pop_back();
+        break;
+    }
+
+    while (this->bytes + frame->size > this->budget || this->entries.size() == MAX_STATE_VARIANTS) {
+        if (!evict_one())
+            return nullptr;
+    }
+
+    struct client_buffer *buffer = create_client_buffer(display, frame->width, frame->height, frame->format);
+    memcpy(buffer->data, frame->data, frame->size);
+
+    entry e = { key, buffer, ++this->tick };
+    this->entries.push_back(e);
+    this->bytes += buffer->size;
+    return buffer;
+}
+
+void StateBufferCache::clear()
+{
+    for (auto &e : this->entries)
+        destroy_client_buffer(e.buffer);
+    this->entries.clear();
+    this->bytes = 0;
+}
+
+size_t StateBufferCache::used() const
+{
+    return this->bytes;
+}
+
+size_t StateBufferCache::budget_from_env()
+{
+    size_t kb = DEFAULT_STATE_CACHE_KB;
+
+    const char *value = getenv("HOMESCREEN_STATE_CACHE_KB");
+    if (value)
+        kb = (size_t) atol(value);
+    return kb * 1024;
+}
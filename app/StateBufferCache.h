@@ -0,0 +1,61 @@
+#ifndef STATE_BUFFER_CACHE_H
+#define STATE_BUFFER_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+struct client_display;
+struct client_buffer;
+
+/* entries per surface, reserved up front so lookups and stores never allocate */
+#define MAX_STATE_VARIANTS 16
+
+/*
+ * Finished frames of one surface kept per content state (theme, drive
+ * mode, ...). The key names everything the frame depends on, so a hit
+ * can be attached as is instead of repainting. Entries are copied from
+ * the first frame rendered in a state and evicted least recently used
+ * first when the memory budget or the entry limit is exceeded.
+ *
+ * Used by the surface thread only.
+ */
+class StateBufferCache
+{
+public:
+    explicit StateBufferCache(size_t budget);
+    ~StateBufferCache();
+
+    /* an idle buffer holding the frame for key at this size, or nullptr */
+    struct client_buffer *find(uint64_t key, int32_t width, int32_t height);
+
+    /*
+     * Copies frame into a cache buffer for key. Returns the new buffer,
+     * or nullptr when it does not fit the budget even after eviction.
+     */
+    struct client_buffer *store(struct client_display *display, uint64_t key,
+                                const struct client_buffer *frame);
+
+    void clear();
+
+    size_t used() const;
+
+    /* HOMESCREEN_STATE_CACHE_KB, per surface */
+    static size_t budget_from_env();
+
+private:
+    struct entry {
+        uint64_t key;
+        struct client_buffer *buffer;
+        uint64_t last_used;
+    };
+
+    std::vector<entry> entries;
+    size_t budget;
+    size_t bytes;
+    uint64_t tick;
+
+    bool evict_one();
+};
+
+#endif /* STATE_BUFFER_CACHE_H */
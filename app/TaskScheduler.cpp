@@ -0,0 +1,443 @@
+#include "TaskScheduler.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+
+struct task {
+    TaskScheduler::task_fn fn;
+    task_group *group;
+};
+
+/*
+ * Chase-Lev work-stealing deque, following the C11 formulation of
+ * Le, Pop, Cohen and Zappa Nardelli. The owner pushes and pops at the
+ * bottom, thieves take from the top. Arrays replaced by a grow are kept
+ * alive until the deque dies since a thief may still be reading them.
+ */
+class task_deque
+{
+public:
+    task_deque() : top(0), bottom(0), array(new ring(256)) {}
+
+    ~task_deque() {
+        delete array.load(std::memory_order_relaxed);
+        for (auto old : retired)
+            delete old;
+    }
+
+    void push(task *t) {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t tp = top.load(std::memory_order_acquire);
+        ring *a = array.load(std::memory_order_relaxed);
+
+        if (b - tp > a->mask) {
+            ring *bigger = a->grow(b, tp);
+            retired.push_back(a);
+            array.store(bigger, std::memory_order_release);
+            a = bigger;
+        }
+        a->put(b, t);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    task *pop() {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        ring *a = array.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t tp = top.load(std::memory_order_relaxed);
+
+        if (tp > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        task *t = a->get(b);
+        if (tp == b) {
+            /* last element, race against thieves for it */
+            if (!top.compare_exchange_strong(tp, tp + 1, std::memory_order_seq_cst,
+                                             std::memory_order_relaxed))
+                t = nullptr;
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return t;
+    }
+
+    task *steal() {
+        int64_t tp = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+
+        if (tp >= b)
+            return nullptr;
+
+        ring *a = array.load(std::memory_order_acquire);
+        task *t = a->get(tp);
+        if (!top.compare_exchange_strong(tp, tp + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed))
+            return nullptr;
+        return t;
+    }
+
+    int64_t size() const {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t tp = top.load(std::memory_order_relaxed);
+        return b > tp ? b - tp : 0;
+    }
+
+private:
+    struct ring {
+        int64_t mask;
+        std::atomic<task *> *slots;
+
+        explicit ring(int64_t capacity) : mask(capacity - 1), slots(new std::atomic<task *>[capacity]) {}
+        ~ring() { delete[] slots; }
+
+        task *get(int64_t i) const { return slots[i & mask].load(std::memory_order_relaxed); }
+        void put(int64_t i, task *t) { slots[i & mask].store(t, std::memory_order_relaxed); }
+
+        ring *grow(int64_t b, int64_t tp) const {
+            ring *bigger = new ring((mask + 1) * 2);
+            for (int64_t i = tp; i < b; i++)
+                bigger->put(i, get(i));
+            return bigger;
+        }
+    };
+
+    std::atomic<int64_t> top;
+    std::atomic<int64_t> bottom;
+    std::atomic<ring *> array;
+    std::vector<ring *> retired;
+};
+
+struct task_worker {
+    int index;
+    task_deque deques[TASK_PRIORITY_COUNT];
+    std::atomic<int64_t> executed{0};
+    std::atomic<int64_t> steals{0};
+    std::atomic<int64_t> steal_attempts{0};
+    uint32_t rng;
+};
+
+static thread_local TaskScheduler *current_scheduler = nullptr;
+static thread_local task_worker *current_worker = nullptr;
+static thread_local uint32_t external_rng = 0x9e3779b9;
+
+static uint32_t next_random(uint32_t *state)
+{
+    /* xorshift32, only used to spread steal victims */
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static void pin_thread(std::thread &thread, int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int rc = pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+    if (rc != 0)
+        fprintf(stderr, "Unable to pin worker to cpu %d: %s\n", cpu, strerror(rc));
+}
+
+TaskScheduler::TaskScheduler(const task_scheduler_config &config)
+{
+    int count = config.worker_count;
+    if (count <= 0)
+        count = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (count <= 0)
+        count = 1;
+
+    for (int i = 0; i < count; i++) {
+        task_worker *worker = new task_worker();
+        worker->index = i;
+        worker->rng = 0x2545f491u * (uint32_t)(i + 1);
+        this->workers.push_back(worker);
+    }
+
+    for (int i = 0; i < count; i++) {
+        this->threads.push_back(std::thread(&TaskScheduler::worker_main, this, this->workers[i]));
+
+        std::string name = "hs-worker-" + std::to_string(i);
+        pthread_setname_np(this->threads.back().native_handle(), name.c_str());
+
+        if (i < (int) config.cpu_affinity.size() && config.cpu_affinity[i] >= 0)
+            pin_thread(this->threads.back(), config.cpu_affinity[i]);
+    }
+    fprintf(stderr, "Started task scheduler with %d workers\n", count);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->sleep_mutex);
+        this->stopping = true;
+    }
+    this->sleep_cond.notify_all();
+
+    for (auto &thread : this->threads)
+        thread.join();
+
+    /* tasks still queued at shutdown are dropped without running */
+    for (auto worker : this->workers) {
+        for (int p = 0; p < TASK_PRIORITY_COUNT; p++) {
+            task *t;
+            while ((t = worker->deques[p].pop()) != nullptr)
+                delete t;
+        }
+        delete worker;
+    }
+    for (int p = 0; p < TASK_PRIORITY_COUNT; p++) {
+        for (auto t : this->injection[p])
+            delete t;
+    }
+}
+
+void TaskScheduler::submit(task_fn fn, task_priority priority, task_group *group)
+{
+    task *t = new task();
+    t->fn = std::move(fn);
+    t->group = group;
+
+    if (group)
+        group->pending.fetch_add(1);
+    this->outstanding.fetch_add(1);
+    this->submitted.fetch_add(1, std::memory_order_relaxed);
+
+    if (current_scheduler == this && current_worker) {
+        current_worker->deques[priority].push(t);
+    } else {
+        std::lock_guard<std::mutex> lock(this->injection_mutex);
+        this->injection[priority].push_back(t);
+    }
+    this->queued.fetch_add(1);
+
+    if (this->sleepers.load() > 0) {
+        std::lock_guard<std::mutex> lock(this->sleep_mutex);
+        this->sleep_cond.notify_one();
+    }
+}
+
+task *TaskScheduler::pop_injected(int priority)
+{
+    std::lock_guard<std::mutex> lock(this->injection_mutex);
+    if (this->injection[priority].empty())
+        return nullptr;
+
+    task *t = this->injection[priority].front();
+    this->injection[priority].pop_front();
+    return t;
+}
+
+task *TaskScheduler::steal_from_others(task_worker *self, int priority)
+{
+    int count = (int) this->workers.size();
+    uint32_t *rng = self ? &self->rng : &external_rng;
+    int start = (int)(next_random(rng) % (uint32_t) count);
+
+    for (int i = 0; i < count; i++) {
+        task_worker *victim = this->workers[(start + i) % count];
+        if (victim == self || victim->deques[priority].size() == 0)
+            continue;
+
+        if (self)
+            self->steal_attempts.fetch_add(1, std::memory_order_relaxed);
+        task *t = victim->deques[priority].steal();
+        if (t) {
+            if (self)
+                self->steals.fetch_add(1, std::memory_order_relaxed);
+            return t;
+        }
+    }
+    return nullptr;
+}
+
+task *TaskScheduler::find_task(task_worker *self)
+{
+    if (this->queued.load() == 0)
+        return nullptr;
+
+    for (int p = 0; p < TASK_PRIORITY_COUNT; p++) {
+        task *t = self ? self->deques[p].pop() : nullptr;
+        if (!t)
+            t = pop_injected(p);
+        if (!t)
+            t = steal_from_others(self, p);
+        if (t)
+            return t;
+    }
+    return nullptr;
+}
+
+void TaskScheduler::execute(task *t)
+{
+    t->fn();
+
+    if (t->group)
+        t->group->pending.fetch_sub(1);
+    delete t;
+
+    if (current_worker && current_scheduler == this)
+        current_worker->executed.fetch_add(1, std::memory_order_relaxed);
+
+    if (this->outstanding.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(this->sleep_mutex);
+        this->idle_cond.notify_all();
+    }
+}
+
+bool TaskScheduler::run_one(task_worker *self)
+{
+    task *t = find_task(self);
+    if (!t)
+        return false;
+
+    this->queued.fetch_sub(1);
+    execute(t);
+    return true;
+}
+
+void TaskScheduler::worker_main(task_worker *worker)
+{
+    current_scheduler = this;
+    current_worker = worker;
+
+    while (true) {
+        if (run_one(worker))
+            continue;
+
+        std::unique_lock<std::mutex> lock(this->sleep_mutex);
+        this->sleepers.fetch_add(1);
+        this->sleep_cond.wait(lock, [this]() {
+            return this->stopping.load() || this->queued.load() > 0;
+        });
+        this->sleepers.fetch_sub(1);
+        if (this->stopping.load())
+            break;
+    }
+
+    current_worker = nullptr;
+    current_scheduler = nullptr;
+}
+
+void TaskScheduler::wait(task_group *group)
+{
+    task_worker *self = current_scheduler == this ? current_worker : nullptr;
+
+    while (group->pending.load() > 0) {
+        if (!run_one(self))
+            std::this_thread::yield();
+    }
+}
+
+void TaskScheduler::wait_idle()
+{
+    task_worker *self = current_scheduler == this ? current_worker : nullptr;
+
+    while (this->outstanding.load() > 0) {
+        if (run_one(self))
+            continue;
+
+        std::unique_lock<std::mutex> lock(this->sleep_mutex);
+        this->idle_cond.wait_for(lock, std::chrono::milliseconds(1), [this]() {
+            return this->outstanding.load() == 0;
+        });
+    }
+}
+
+void TaskScheduler::parallel_for(int32_t begin, int32_t end, int32_t grain,
+                                 std::function<void(int32_t, int32_t)> fn,
+                                 task_priority priority)
+{
+    if (grain <= 0)
+        grain = 1;
+    if (end - begin <= grain) {
+        fn(begin, end);
+        return;
+    }
+
+    task_group group;
+    for (int32_t start = begin; start < end; start += grain) {
+        int32_t stop = start + grain < end ? start + grain : end;
+        submit([&fn, start, stop]() { fn(start, stop); }, priority, &group);
+    }
+    wait(&group);
+}
+
+int TaskScheduler::worker_count() const
+{
+    return (int) this->workers.size();
+}
+
+task_scheduler_stats TaskScheduler::stats() const
+{
+    task_scheduler_stats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    for (int p = 0; p < TASK_PRIORITY_COUNT; p++) {
+        for (auto worker : this->workers)
+            stats.queue_depth[p] += worker->deques[p].size();
+        std::lock_guard<std::mutex> lock(this->injection_mutex);
+        stats.queue_depth[p] += (int64_t) this->injection[p].size();
+    }
+    for (auto worker : this->workers) {
+        stats.executed += worker->executed.load(std::memory_order_relaxed);
+        stats.steals += worker->steals.load(std::memory_order_relaxed);
+        stats.steal_attempts += worker->steal_attempts.load(std::memory_order_relaxed);
+    }
+    stats.submitted = this->submitted.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void TaskScheduler::dump_stats(FILE *out) const
+{
+    task_scheduler_stats s = stats();
+
+    fprintf(out, "scheduler: %d workers, %lld submitted, %lld executed by workers\n",
+            worker_count(), (long long) s.submitted, (long long) s.executed);
+    fprintf(out, "scheduler: queue depth high %lld normal %lld low %lld\n",
+            (long long) s.queue_depth[TASK_PRIORITY_HIGH],
+            (long long) s.queue_depth[TASK_PRIORITY_NORMAL],
+            (long long) s.queue_depth[TASK_PRIORITY_LOW]);
+    fprintf(out, "scheduler: %lld steals out of %lld attempts\n",
+            (long long) s.steals, (long long) s.steal_attempts);
+    for (auto worker : this->workers) {
+        fprintf(out, "scheduler: worker %d executed %lld stole %lld\n", worker->index,
+                (long long) worker->executed.load(std::memory_order_relaxed),
+                (long long) worker->steals.load(std::memory_order_relaxed));
+    }
+}
+
+/*
+ * HOMESCREEN_WORKERS sets the worker count, HOMESCREEN_WORKER_CPUS a
+ * comma separated list of CPUs the workers get pinned to, in order.
+ */
+task_scheduler_config TaskScheduler::config_from_env()
+{
+    task_scheduler_config config;
+
+    const char *workers = getenv("HOMESCREEN_WORKERS");
+    if (workers)
+        config.worker_count = atoi(workers);
+
+    const char *cpus = getenv("HOMESCREEN_WORKER_CPUS");
+    while (cpus && *cpus) {
+        char *end;
+        long cpu = strtol(cpus, &end, 10);
+        if (end == cpus)
+            break;
+        config.cpu_affinity.push_back((int) cpu);
+        cpus = *end == ',' ? end + 1 : end;
+    }
+    return config;
+}
@@ -0,0 +1,103 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum task_priority {
+    TASK_PRIORITY_HIGH = 0,   /* work needed for the next frame */
+    TASK_PRIORITY_NORMAL,     /* decoding of assets about to be shown */
+    TASK_PRIORITY_LOW,        /* prefetch and housekeeping */
+    TASK_PRIORITY_COUNT
+};
+
+struct task_scheduler_config {
+    /* 0 picks the number of online CPUs. */
+    int worker_count = 0;
+    /* Optional CPU per worker; workers beyond the list stay unpinned. */
+    std::vector<int> cpu_affinity;
+};
+
+struct task_scheduler_stats {
+    int64_t queue_depth[TASK_PRIORITY_COUNT];
+    int64_t submitted;
+    int64_t executed;
+    int64_t steals;
+    int64_t steal_attempts;
+};
+
+struct task;
+struct task_worker;
+class task_deque;
+
+/*
+ * Tracks completion of a batch of tasks. A thread waiting on a group
+ * keeps executing queued tasks instead of sleeping, so waiting from
+ * inside a worker does not deadlock the pool.
+ */
+struct task_group {
+    std::atomic<int64_t> pending{0};
+};
+
+/*
+ * Work-stealing thread pool. Every worker owns one Chase-Lev deque per
+ * priority; tasks submitted from a worker go to its own deque, tasks
+ * submitted from any other thread go to a shared injection queue. Idle
+ * workers steal from the top of their siblings' deques.
+ */
+class TaskScheduler
+{
+public:
+    typedef std::function<void()> task_fn;
+
+    explicit TaskScheduler(const task_scheduler_config &config);
+    ~TaskScheduler();
+
+    void submit(task_fn fn, task_priority priority = TASK_PRIORITY_NORMAL,
+                task_group *group = nullptr);
+    void wait(task_group *group);
+    void wait_idle();
+
+    /* Splits [begin, end) into chunks of at most grain and waits for all of them. */
+    void parallel_for(int32_t begin, int32_t end, int32_t grain,
+                      std::function<void(int32_t, int32_t)> fn,
+                      task_priority priority = TASK_PRIORITY_HIGH);
+
+    int worker_count() const;
+    task_scheduler_stats stats() const;
+    void dump_stats(FILE *out) const;
+
+    static task_scheduler_config config_from_env();
+
+private:
+    std::vector<task_worker *> workers;
+    std::vector<std::thread> threads;
+
+    mutable std::mutex injection_mutex;
+    std::deque<task *> injection[TASK_PRIORITY_COUNT];
+
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cond;
+    std::condition_variable idle_cond;
+    std::atomic<int64_t> queued{0};
+    std::atomic<int64_t> sleepers{0};
+    std::atomic<int64_t> outstanding{0};
+    std::atomic<int64_t> submitted{0};
+    std::atomic<bool> stopping{false};
+
+    void worker_main(task_worker *worker);
+    bool run_one(task_worker *self);
+    task *find_task(task_worker *self);
+    task *pop_injected(int priority);
+    task *steal_from_others(task_worker *self, int priority);
+    void execute(task *t);
+};
+
+#endif /* TASK_SCHEDULER_H */
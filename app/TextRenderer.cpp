@@ -0,0 +1,244 @@
+#include "TextRenderer.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_FREETYPE
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#endif
+
+#define DEFAULT_FONT "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf"
+#define REPLACEMENT_CHARACTER 0xfffd
+
+TextRenderer::TextRenderer()
+{
+    this->library = nullptr;
+    this->face = nullptr;
+    this->face_size = 0;
+    this->hits = 0;
+    this->misses = 0;
+    this->rasterized = 0;
+}
+
+TextRenderer::~TextRenderer()
+{
+#ifdef HAVE_FREETYPE
+    if (this->face)
+        FT_Done_Face(this->face);
+    if (this->library)
+        FT_Done_FreeType(this->library);
+#endif
+}
+
+const char *TextRenderer::font_path()
+{
+    const char *path = getenv("HOMESCREEN_FONT");
+    return path ? path : DEFAULT_FONT;
+}
+
+bool TextRenderer::load_font(const char *path)
+{
+#ifdef HAVE_FREETYPE
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (!this->library && FT_Init_FreeType(&this->library) != 0) {
+        this->library = nullptr;
+        fprintf(stderr, "initializing FreeType failed\n");
+        return false;
+    }
+
+    FT_Face loaded;
+    if (FT_New_Face(this->library, path, 0, &loaded) != 0) {
+        fprintf(stderr, "loading font %s failed\n", path);
+        return false;
+    }
+    if (this->face) {
+        /* glyph indices belong to the old face */
+        FT_Done_Face(this->face);
+        this->atlas.clear();
+        this->runs.clear();
+        this->run_index.clear();
+    }
+    this->face = loaded;
+    this->face_size = 0;
+    return true;
+#else
+    fprintf(stderr, "built without FreeType, not loading font %s\n", path);
+    return false;
+#endif
+}
+
+/* next code point of UTF-8 text at pos, malformed bytes decode as U+FFFD */
+static uint32_t next_code_point(const std::string &text, size_t &pos)
+{
+    uint8_t c = (uint8_t) text[pos++];
+    if (c < 0x80)
+        return c;
+
+    int32_t extra = c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : c >= 0xc0 ? 1 : -1;
+    if (extra < 0 || c >= 0xf8)
+        return REPLACEMENT_CHARACTER;
+
+    uint32_t cp = c & (0x3f >> extra);
+    for (int32_t i = 0; i < extra; i++) {
+        if (pos >= text.size() || ((uint8_t) text[pos] & 0xc0) != 0x80)
+            return REPLACEMENT_CHARACTER;
+        cp = (cp << 6) | ((uint8_t) text[pos++] & 0x3f);
+    }
+    return cp;
+}
+
+const glyph_slot *TextRenderer::glyph(uint32_t glyph_index, int32_t size)
+{
+#ifdef HAVE_FREETYPE
+    uint64_t key = GlyphAtlas::key(size, glyph_index);
+    const glyph_slot *slot = this->atlas.find(key);
+    if (slot)
+        return slot;
+
+    /* failures become blank glyphs, so they are not retried every time */
+    if (FT_Load_Glyph(this->face, glyph_index, FT_LOAD_RENDER) != 0)
+        return this->atlas.insert(key, 0, 0, 0, 0, 0);
+
+    FT_GlyphSlot g = this->face->glyph;
+    const FT_Bitmap &bitmap = g->bitmap;
+    bool gray = bitmap.pixel_mode == FT_PIXEL_MODE_GRAY && bitmap.pitch > 0;
+    int32_t width = gray ? (int32_t) bitmap.width : 0;
+    int32_t height = gray ? (int32_t) bitmap.rows : 0;
+
+    slot = this->atlas.insert(key, width, height, g->bitmap_left, g->bitmap_top, (int32_t) g->advance.x);
+    if (!slot)
+        return nullptr;
+
+    uint8_t *dst = this->atlas.data() + slot->area.y * this->atlas.stride() + slot->area.x;
+    for (int32_t y = 0; y < height; y++)
+        memcpy(dst + y * this->atlas.stride(), bitmap.buffer + y * bitmap.pitch, width);
+    this->rasterized++;
+    return slot;
+#else
+    return nullptr;
+#endif
+}
+
+std::shared_ptr<const text_run> TextRenderer::layout(const std::string &text, int32_t size)
+{
+#ifdef HAVE_FREETYPE
+    struct placed_glyph {
+        glyph_slot slot;
+        int32_t x;
+    };
+
+    if (this->face_size != size) {
+        if (FT_Set_Pixel_Sizes(this->face, 0, size) != 0)
+            return nullptr;
+        this->face_size = size;
+    }
+
+    std::vector<placed_glyph> placed;
+    int64_t pen = 0;
+
+    /* a full atlas is cleared once and the string laid out again */
+    for (int attempt = 0; attempt < 2; attempt++) {
+        bool full = false;
+        uint32_t previous = 0;
+        placed.clear();
+        pen = 0;
+
+        for (size_t pos = 0; pos < text.size() && !full;) {
+            uint32_t index = FT_Get_Char_Index(this->face, next_code_point(text, pos));
+            if (previous && index && FT_HAS_KERNING(this->face)) {
+                FT_Vector delta;
+                if (FT_Get_Kerning(this->face, previous, index, FT_KERNING_DEFAULT, &delta) == 0)
+                    pen += delta.x;
+            }
+            previous = index;
+
+            const glyph_slot *slot = glyph(index, size);
+            if (!slot) {
+                full = true;
+                break;
+            }
+            placed_glyph p = { *slot, (int32_t) ((pen + 32) >> 6) };
+            placed.push_back(p);
+            pen += slot->advance;
+        }
+        if (!full)
+            break;
+        if (attempt > 0)
+            return nullptr;
+        this->atlas.clear();
+    }
+
+    const FT_Size_Metrics &metrics = this->face->size->metrics;
+    std::shared_ptr<text_run> run = std::make_shared<text_run>();
+    run->baseline = (int32_t) ((metrics.ascender + 63) >> 6);
+    run->height = run->baseline + (int32_t) ((-metrics.descender + 63) >> 6);
+    run->width = (int32_t) ((pen + 63) >> 6);
+    for (auto &p : placed)
+        if (p.x + p.slot.left + p.slot.area.width > run->width)
+            run->width = p.x + p.slot.left + p.slot.area.width;
+    if (run->width <= 0 || run->height <= 0)
+        return nullptr;
+    run->mask.assign((size_t) run->width * run->height, 0);
+
+    /* saturating add, so touching glyphs do not punch holes into each other */
+    for (auto &p : placed) {
+        const uint8_t *src = this->atlas.data() + p.slot.area.y * this->atlas.stride() + p.slot.area.x;
+        for (int32_t y = 0; y < p.slot.area.height; y++) {
+            int32_t ty = run->baseline - p.slot.top + y;
+            if (ty < 0 || ty >= run->height)
+                continue;
+            uint8_t *dst = run->mask.data() + (size_t) ty * run->width;
+            for (int32_t x = 0; x < p.slot.area.width; x++) {
+                int32_t tx = p.x + p.slot.left + x;
+                if (tx < 0 || tx >= run->width)
+                    continue;
+                uint32_t sum = dst[tx] + src[y * this->atlas.stride() + x];
+                dst[tx] = (uint8_t) (sum > 255 ? 255 : sum);
+            }
+        }
+    }
+    return run;
+#else
+    return nullptr;
+#endif
+}
+
+std::shared_ptr<const text_run> TextRenderer::shape(const std::string &text, int32_t size)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (!this->face || text.empty() || size <= 0)
+        return nullptr;
+
+    char prefix[16];
+    snprintf(prefix, sizeof(prefix), "%d:", size);
+    std::string key = prefix + text;
+
+    auto it = this->run_index.find(key);
+    if (it != this->run_index.end()) {
+        this->hits++;
+        this->runs.splice(this->runs.begin(), this->runs, it->second);
+        return it->second->run;
+    }
+
+    this->misses++;
+    std::shared_ptr<const text_run> run = layout(text, size);
+    if (!run)
+        return nullptr;
+
+    cached_run entry = { key, run };
+    this->runs.push_front(entry);
+    this->run_index[key] = this->runs.begin();
+    if (this->runs.size() > MAX_TEXT_RUNS) {
+        this->run_index.erase(this->runs.back().key);
+        this->runs.pop_back();
+    }
+    return run;
+}
+
+void TextRenderer::dump_stats(FILE *out)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    fprintf(out, "text: %zu runs cached, %llu hits, %llu misses\n", this->runs.size(),
+            (unsigned long long) this->hits, (unsigned long long) this->misses);
+    fprintf(out, "text: %zu glyphs in atlas, %llu rasterized, atlas cleared %u times\n",
+            this->atlas.glyph_count(), (unsigned long long) this->rasterized, this->atlas.clear_count());
+}
@@ -0,0 +1,76 @@
+#ifndef TEXT_RENDERER_H
+#define TEXT_RENDERER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "GlyphAtlas.h"
+
+struct FT_LibraryRec_;
+struct FT_FaceRec_;
+
+/* runs kept for reuse, least recently shaped go first */
+#define MAX_TEXT_RUNS 64
+
+/* a shaped string as 8-bit coverage, drawn in any color */
+struct text_run {
+    std::vector<uint8_t> mask;
+    int32_t width;
+    int32_t height;
+    int32_t baseline;
+};
+
+/*
+ * Lays out and rasterizes strings with FreeType. Glyphs come from a
+ * shared GlyphAtlas, whole strings are composed once per string and
+ * pixel size into a run that stays cached, so text that does not change
+ * costs nothing per frame. Runs are shared, whoever still holds one
+ * keeps it valid after it left the cache or the atlas was cleared.
+ *
+ * Shaping is left to right with kerning, no ligatures or bidi. Safe to
+ * use from all render threads. Needs FreeType at build time
+ * (HAVE_FREETYPE), otherwise no font loads and shape() returns nullptr.
+ */
+class TextRenderer
+{
+public:
+    TextRenderer();
+    ~TextRenderer();
+
+    bool load_font(const char *path);
+
+    std::shared_ptr<const text_run> shape(const std::string &text, int32_t size);
+
+    void dump_stats(FILE *out);
+
+    /* HOMESCREEN_FONT or a common system font */
+    static const char *font_path();
+
+private:
+    struct cached_run {
+        std::string key;
+        std::shared_ptr<const text_run> run;
+    };
+
+    std::mutex mutex;
+    FT_LibraryRec_ *library;
+    FT_FaceRec_ *face;
+    int32_t face_size;
+    GlyphAtlas atlas;
+
+    std::list<cached_run> runs;
+    std::unordered_map<std::string, std::list<cached_run>::iterator> run_index;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t rasterized;
+
+    const glyph_slot *glyph(uint32_t glyph_index, int32_t size);
+    std::shared_ptr<const text_run> layout(const std::string &text, int32_t size);
+};
+
+#endif /* TEXT_RENDERER_H */
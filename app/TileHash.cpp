@@ -0,0 +1,106 @@
+#include "TileHash.h"
+
+#define PRIME32_1 0x9E3779B1U
+#define PRIME32_2 0x85EBCA77U
+#define PRIME32_3 0xC2B2AE3DU
+#define PRIME32_4 0x27D4EB2FU
+#define PRIME32_5 0x165667B1U
+
+static inline uint32_t rotl32(uint32_t x, int r)
+{
+    return (x << r) | (x >> (32 - r));
+}
+
+static inline uint32_t hash_round(uint32_t acc, uint32_t input)
+{
+    acc += input * PRIME32_2;
+    acc = rotl32(acc, 13);
+    return acc * PRIME32_1;
+}
+
+uint32_t hash_tile(const uint32_t *pixels, int32_t stride, const rect &tile)
+{
+    uint32_t lanes[4] = {
+        PRIME32_1 + PRIME32_2,
+        PRIME32_2,
+        0,
+        0 - PRIME32_1
+    };
+
+    for (int32_t y = 0; y < tile.height; y++) {
+        const uint32_t *row = pixels + (tile.y + y) * stride + tile.x;
+        int32_t x = 0;
+        for (; x + 4 <= tile.width; x += 4) {
+            for (int lane = 0; lane < 4; lane++)
+                lanes[lane] = hash_round(lanes[lane], row[x + lane]);
+        }
+        for (; x < tile.width; x++)
+            lanes[x & 3] = hash_round(lanes[x & 3], row[x]);
+    }
+
+    uint32_t h = rotl32(lanes[0], 1) + rotl32(lanes[1], 7) + rotl32(lanes[2], 12) + rotl32(lanes[3], 18);
+    h += (uint32_t) (tile.width * tile.height) * 4;
+
+    h ^= h >> 15;
+    h *= PRIME32_2;
+    h ^= h >> 13;
+    h *= PRIME32_3;
+    h ^= h >> 16;
+    return h;
+}
+
+FrameTileHashes::FrameTileHashes()
+{
+    this->width = 0;
+    this->height = 0;
+    this->columns = 0;
+    this->rows = 0;
+    this->valid = false;
+}
+
+void FrameTileHashes::reset(int32_t width, int32_t height)
+{
+    this->width = width;
+    this->height = height;
+    this->columns = (width + HASH_TILE_SIZE - 1) / HASH_TILE_SIZE;
+    this->rows = (height + HASH_TILE_SIZE - 1) / HASH_TILE_SIZE;
+    this->hashes.assign((size_t) this->columns * this->rows, 0);
+    this->valid = false;
+}
+
+bool FrameTileHashes::compare(const uint32_t *pixels, int32_t stride, std::vector<rect> &damage)
+{
+    bool changed = false;
+
+    for (int32_t row = 0; row < this->rows; row++) {
+        int32_t y = row * HASH_TILE_SIZE;
+        int32_t tile_height = this->height - y < HASH_TILE_SIZE ? this->height - y : HASH_TILE_SIZE;
+        /* changed tiles next to each other in a row go out as one rect */
+        int32_t run_start = -1;
+
+        for (int32_t column = 0; column <= this->columns; column++) {
+            bool differs = false;
+            if (column < this->columns) {
+                int32_t x = column * HASH_TILE_SIZE;
+                int32_t tile_width = this->width - x < HASH_TILE_SIZE ? this->width - x : HASH_TILE_SIZE;
+                uint32_t h = hash_tile(pixels, stride, make_rect(x, y, tile_width, tile_height));
+                uint32_t &previous = this->hashes[row * this->columns + column];
+                differs = !this->valid || h != previous;
+                previous = h;
+            }
+
+            if (differs && run_start < 0) {
+                run_start = column;
+            } else if (!differs && run_start >= 0) {
+                int32_t x = run_start * HASH_TILE_SIZE;
+                int32_t end = column * HASH_TILE_SIZE < this->width ? column * HASH_TILE_SIZE : this->width;
+                damage_add(damage, make_rect(x, y, end - x, tile_height));
+                run_start = -1;
+                changed = true;
+            }
+        }
+    }
+
+    this->valid = true;
+    return changed;
+}
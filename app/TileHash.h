@@ -0,0 +1,44 @@
+#ifndef TILE_HASH_H
+#define TILE_HASH_H
+
+#include <stdint.h>
+#include <vector>
+#include "Geometry.h"
+
+#define HASH_TILE_SIZE 64
+
+/*
+ * xxHash32-style hash of the pixels inside tile. Four independent lanes
+ * take one pixel each per step, so the inner loop vectorizes.
+ */
+uint32_t hash_tile(const uint32_t *pixels, int32_t stride, const rect &tile);
+
+/*
+ * Per-tile hashes of the last presented frame of a surface. Comparing a
+ * new frame against them finds the tiles that actually changed, for
+ * draw callbacks that repaint everything and cannot say what changed.
+ */
+class FrameTileHashes
+{
+public:
+    FrameTileHashes();
+
+    /* forgets the previous frame, the next compare damages everything */
+    void reset(int32_t width, int32_t height);
+
+    /*
+     * Hashes every tile of the frame and adds the tiles that differ from
+     * the previous frame to damage. Returns false for an identical frame.
+     */
+    bool compare(const uint32_t *pixels, int32_t stride, std::vector<rect> &damage);
+
+private:
+    std::vector<uint32_t> hashes;
+    int32_t width;
+    int32_t height;
+    int32_t columns;
+    int32_t rows;
+    bool valid;
+};
+
+#endif /* TILE_HASH_H */
@@ -0,0 +1,163 @@
+#include "Wallpaper.h"
+#include "AssetStore.h"
+#include "DiskCache.h"
+#include "ImageDecoder.h"
+#include "PixelKernels.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+#include <wayland-client.h>
+
+static const char wallpaper_magic[4] = { 'H', 'S', 'W', 'P' };
+
+const CachedImage &Wallpaper::cached_image() const
+{
+    return this->cached;
+}
+
+/* the source by path, size and mtime, at the output size */
+static uint64_t source_key(const char *path, const struct stat &source, int32_t width, int32_t height)
+{
+    char text[64];
+    snprintf(text, sizeof(text), "|%llu|%lld|%dx%d", (unsigned long long) source.st_size,
+             (long long) source.st_mtime, width, height);
+    return cache_hash((std::string(path) + text).c_str());
+}
+
+bool Wallpaper::convert(const char *path, int32_t width, int32_t height, std::vector<uint32_t> &pixels)
+{
+    decoded_image decoded;
+    if (!decode_image(path, decoded))
+        return false;
+
+    /* scale to cover the output, the overhanging part is cropped evenly */
+    rect area;
+    if ((int64_t) decoded.width * height > (int64_t) decoded.height * width) {
+        area.height = decoded.height;
+        area.width = (int32_t) ((int64_t) decoded.height * width / height);
+    } else {
+        area.width = decoded.width;
+        area.height = (int32_t) ((int64_t) decoded.width * height / width);
+    }
+    area.width = area.width > 0 ? area.width : 1;
+    area.height = area.height > 0 ? area.height : 1;
+    area.x = (decoded.width - area.width) / 2;
+    area.y = (decoded.height - area.height) / 2;
+
+    pixels.resize((size_t) width * height);
+    resample(pixels.data(), width, width, height, decoded.pixels.data(), decoded.width, area);
+
+    /* XRGB8888: translucent images end up composited over black */
+    for (auto &pixel : pixels)
+        pixel |= 0xff000000;
+    return true;
+}
+
+bool Wallpaper::read_store(const AssetStore &store, const char *name, const struct stat &source,
+                           int32_t width, int32_t height, TaskScheduler *scheduler)
+{
+    const asset_entry *entry = store.find(name);
+    if (!entry || entry->width != width || entry->height != height ||
+        entry->stride != width * 4 || entry->format != WL_SHM_FORMAT_XRGB8888 ||
+        entry->raw_size != (uint64_t) entry->stride * height ||
+        entry->tag[0] != (uint64_t) source.st_size || entry->tag[1] != (uint64_t) source.st_mtime)
+        return false;
+
+    /* decompressed straight into the file later handed to the compositor */
+    int image_fd = os_create_anonymous_file((off_t) entry->raw_size);
+    if (image_fd < 0)
+        return false;
+
+    void *mapping = mmap(NULL, entry->raw_size, PROT_READ | PROT_WRITE, MAP_SHARED, image_fd, 0);
+    if (mapping == MAP_FAILED) {
+        close(image_fd);
+        return false;
+    }
+
+    if (!store.read(entry, mapping, scheduler)) {
+        munmap(mapping, entry->raw_size);
+        close(image_fd);
+        return false;
+    }
+
+    this->cached.adopt(image_fd, mapping, width, height);
+    return true;
+}
+
+bool Wallpaper::load_from_store(const char *path, const std::string &directory, const struct stat &source,
+                                int32_t width, int32_t height, TaskScheduler *scheduler)
+{
+    AssetStore store;
+    bool opened = store.open(directory + "/assets.hsa");
+
+    char name[ASSET_NAME_SIZE];
+    snprintf(name, sizeof(name), "wallpaper-%016llx-%dx%d",
+             (unsigned long long) cache_hash(path), width, height);
+
+    if (opened && read_store(store, name, source, width, height, scheduler)) {
+        fprintf(stderr, "Decompressed wallpaper %s from the asset store\n", name);
+        return true;
+    }
+
+    fprintf(stderr, "Converting wallpaper %s for %dx%d\n", path, width, height);
+    std::vector<uint32_t> pixels;
+    if (!convert(path, width, height, pixels))
+        return false;
+
+    asset_entry entry;
+    memset(&entry, 0, sizeof(entry));
+    snprintf(entry.name, sizeof(entry.name), "%s", name);
+    entry.width = width;
+    entry.height = height;
+    entry.stride = width * 4;
+    entry.format = WL_SHM_FORMAT_XRGB8888;
+    entry.tag[0] = (uint64_t) source.st_size;
+    entry.tag[1] = (uint64_t) source.st_mtime;
+    entry.raw_size = pixels.size() * sizeof(uint32_t);
+    if (opened && store.add(entry, pixels.data()) && read_store(store, name, source, width, height, scheduler))
+        return true;
+
+    fprintf(stderr, "Wallpaper %s not stored, it is kept in memory\n", path);
+    this->cached.keep(width, height, pixels);
+    return true;
+}
+
+bool Wallpaper::load(const char *path, int32_t width, int32_t height, TaskScheduler *scheduler)
+{
+    struct stat source;
+    if (stat(path, &source) < 0) {
+        fprintf(stderr, "wallpaper %s not available: %m\n", path);
+        return false;
+    }
+
+    this->cached.unmap();
+    std::string directory = cache_directory();
+    std::string cache_path;
+    uint64_t key = source_key(path, source, width, height);
+    if (!directory.empty()) {
+        if (getenv("HOMESCREEN_ASSET_STORE") && AssetStore::available())
+            return load_from_store(path, directory, source, width, height, scheduler);
+
+        char name[64];
+        snprintf(name, sizeof(name), "/wallpaper-%016llx-%dx%d.raw",
+                 (unsigned long long) cache_hash(path), width, height);
+        cache_path = directory + name;
+
+        if (this->cached.map(cache_path, wallpaper_magic, WALLPAPER_CACHE_VERSION, key, width, height)) {
+            fprintf(stderr, "Mapped cached wallpaper %s\n", cache_path.c_str());
+            return true;
+        }
+    }
+
+    fprintf(stderr, "Converting wallpaper %s for %dx%d\n", path, width, height);
+    std::vector<uint32_t> pixels;
+    if (!convert(path, width, height, pixels))
+        return false;
+
+    if (!this->cached.store(cache_path, wallpaper_magic, WALLPAPER_CACHE_VERSION, key, width, height, pixels))
+        fprintf(stderr, "Wallpaper %s not cached, it is kept in memory\n", path);
+    return true;
+}
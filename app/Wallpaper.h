@@ -0,0 +1,47 @@
+#ifndef WALLPAPER_H
+#define WALLPAPER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include "CachedImage.h"
+
+class AssetStore;
+class TaskScheduler;
+
+#define WALLPAPER_CACHE_VERSION 2
+
+/*
+ * Background image converted to the output's resolution. The first load
+ * of an image decodes it, scales it to cover the output, converts it to
+ * XRGB8888 and keeps the result as a CachedImage. Later loads map that
+ * file, so a boot only pages the pixels in. Entries are keyed by source
+ * path, size and mtime and by the output size; a changed source or
+ * cache version rebuilds them.
+ *
+ * With HOMESCREEN_ASSET_STORE set the converted pixels go to the LZ4
+ * asset store instead, and a load decompresses them on the scheduler
+ * into an anonymous shm file. That trades CPU for reading less from
+ * slow storage.
+ */
+class Wallpaper
+{
+public:
+    /* decodes and scales on a cache miss, seconds for a large photo */
+    bool load(const char *path, int32_t width, int32_t height, TaskScheduler *scheduler);
+
+    const CachedImage &cached_image() const;
+
+private:
+    CachedImage cached;
+
+    bool read_store(const AssetStore &store, const char *name, const struct stat &source,
+                    int32_t width, int32_t height, TaskScheduler *scheduler);
+    bool load_from_store(const char *path, const std::string &directory, const struct stat &source,
+                         int32_t width, int32_t height, TaskScheduler *scheduler);
+    bool convert(const char *path, int32_t width, int32_t height, std::vector<uint32_t> &pixels);
+};
+
+#endif /* WALLPAPER_H */
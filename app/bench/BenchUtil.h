@@ -0,0 +1,34 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+/* median wall time of runs calls to fn in milliseconds, after one warm-up call */
+static inline double median_ms(int runs, const std::function<void()> &fn)
+{
+    fn();
+    std::vector<double> times;
+    for (int i = 0; i < runs; i++) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        times.push_back(elapsed.count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+/* deterministic noise, so every run sees the same pixels */
+static inline void fill_pixels(std::vector<uint32_t> &pixels, uint32_t seed)
+{
+    for (auto &pixel : pixels) {
+        seed = seed * 1664525u + 1013904223u;
+        pixel = 0xff000000 | (seed >> 8);
+    }
+}
+
+#endif /* BENCH_UTIL_H */
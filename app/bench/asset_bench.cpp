@@ -0,0 +1,179 @@
+#include "AssetStore.h"
+#include "BenchUtil.h"
+#include "DiskCache.h"
+#include "PixelKernels.h"
+#include "TaskScheduler.h"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Cold-cache load of a full screen image, raw from a cache file as the
+ * wallpaper and backdrop caches store it, and LZ4 compressed from the
+ * asset store. The page cache is dropped for the file before every run
+ * with posix_fadvise(POSIX_FADV_DONTNEED), so each load reads storage.
+ * The first argument is the directory for the test files, by default
+ * the current one; it must be on the storage being measured, a tmpfs
+ * cannot drop its pages.
+ */
+
+#define RUNS 9
+
+struct raw_header {
+    char magic[4];
+    uint32_t size;
+    uint64_t data_offset;
+};
+
+static const uint8_t dither[8] = { 0, 32, 8, 40, 2, 34, 10, 42 };
+
+/* a dithered diagonal gradient, like a generated backdrop */
+static void fill_gradient(std::vector<uint32_t> &pixels, int32_t width, int32_t height)
+{
+    std::vector<uint16_t> t(width);
+    for (int32_t y = 0; y < height; y++) {
+        for (int32_t x = 0; x < width; x++)
+            t[x] = (uint16_t) ((int64_t) (x + y) * 65535 / (width + height - 2));
+        gradient_span(pixels.data() + (size_t) y * width, t.data(), width, 0xff1c2430, 0xff05070a, dither);
+    }
+}
+
+/* solid 64x64 cells, like an icon atlas with a lot of background */
+static void fill_cells(std::vector<uint32_t> &pixels, int32_t width, int32_t height)
+{
+    for (int32_t y = 0; y < height; y++) {
+        for (int32_t x = 0; x < width; x++)
+            pixels[(size_t) y * width + x] = 0xff000000 | (uint32_t) ((x >> 6) * 0x1f3d5b + (y >> 6) * 0x0b0907);
+    }
+}
+
+static bool drop_cached_pages(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    fdatasync(fd);
+    int error = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    return error == 0;
+}
+
+/* median of the load times in milliseconds, optionally with a cold page cache per run */
+static double time_load(const std::string &path, bool cold, const std::function<bool()> &load)
+{
+    std::vector<double> times;
+    for (int i = 0; i < RUNS; i++) {
+        if (cold && !drop_cached_pages(path))
+            return -1;
+        auto start = std::chrono::steady_clock::now();
+        if (!load())
+            return -1;
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        times.push_back(elapsed.count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+static bool load_raw(const std::string &path, std::vector<uint32_t> &dst)
+{
+    raw_header h;
+    mapped_cache_file file;
+    if (!cache_map(path, &h, sizeof(h), [&](uint64_t &data_offset, uint64_t &data_size) {
+            data_offset = h.data_offset;
+            data_size = h.size;
+            return memcmp(h.magic, "BNCH", 4) == 0 && h.size == dst.size() * sizeof(uint32_t);
+        }, file))
+        return false;
+    /* every page is read, as the compositor does when it uploads the buffer */
+    memcpy(dst.data(), (const uint8_t *) file.data + h.data_offset, h.size);
+    cache_unmap(file);
+    return true;
+}
+
+static void run(const std::string &directory, const char *name, std::vector<uint32_t> &pixels,
+                int32_t width, int32_t height, TaskScheduler &scheduler)
+{
+    std::string raw_path = directory + "/asset-bench-" + name + ".raw";
+    std::string store_path = directory + "/asset-bench-" + name + ".store";
+    std::vector<uint32_t> dst(pixels.size());
+
+    raw_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, "BNCH", 4);
+    h.size = (uint32_t) (pixels.size() * sizeof(uint32_t));
+    h.data_offset = CACHE_PAGE_SIZE;
+    if (!cache_write(raw_path, &h, sizeof(h), pixels.data(), h.size, (off_t) h.data_offset)) {
+        fprintf(stderr, "cannot write %s\n", raw_path.c_str());
+        return;
+    }
+
+    for (int cold = 1; cold >= 0; cold--) {
+        double ms = time_load(raw_path, cold, [&]() { return load_raw(raw_path, dst); });
+        printf("%4dx%-4d %-8s %-4s %-4s %9.3f %10u\n", width, height, name, "raw", cold ? "cold" : "warm",
+               ms, h.size / 1024);
+    }
+    unlink(raw_path.c_str());
+
+    if (!AssetStore::available()) {
+        printf("%4dx%-4d %-8s %-4s built without liblz4\n", width, height, name, "lz4");
+        return;
+    }
+
+    unlink(store_path.c_str());
+    asset_entry entry;
+    memset(&entry, 0, sizeof(entry));
+    snprintf(entry.name, sizeof(entry.name), "%s", name);
+    entry.width = width;
+    entry.height = height;
+    entry.stride = width * 4;
+    entry.raw_size = h.size;
+    {
+        AssetStore store;
+        if (!store.open(store_path) || !store.add(entry, pixels.data())) {
+            fprintf(stderr, "cannot write %s\n", store_path.c_str());
+            return;
+        }
+    }
+
+    struct stat st;
+    int fd = open(store_path.c_str(), O_RDONLY | O_CLOEXEC);
+    off_t stored = fd >= 0 && fstat(fd, &st) == 0 ? st.st_size : 0;
+    if (fd >= 0)
+        close(fd);
+
+    for (int cold = 1; cold >= 0; cold--) {
+        double ms = time_load(store_path, cold, [&]() {
+            AssetStore store;
+            const asset_entry *e;
+            return store.open(store_path) && (e = store.find(name)) && store.read(e, dst.data(), &scheduler);
+        });
+        printf("%4dx%-4d %-8s %-4s %-4s %9.3f %10llu\n", width, height, name, "lz4", cold ? "cold" : "warm",
+               ms, (unsigned long long) (stored / 1024));
+    }
+    unlink(store_path.c_str());
+}
+
+int main(int argc, char **argv)
+{
+    std::string directory = argc > 1 ? argv[1] : ".";
+    TaskScheduler scheduler(TaskScheduler::config_from_env());
+
+    printf("%-9s %-8s %-4s %-4s %9s %10s\n", "size", "content", "kind", "page", "median ms", "file KB");
+    const int32_t sizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+    for (auto &size : sizes) {
+        int32_t width = size[0], height = size[1];
+        std::vector<uint32_t> pixels((size_t) width * height);
+
+        fill_gradient(pixels, width, height);
+        run(directory, "gradient", pixels, width, height, scheduler);
+        fill_cells(pixels, width, height);
+        run(directory, "cells", pixels, width, height, scheduler);
+        fill_pixels(pixels, 1);
+        run(directory, "noise", pixels, width, height, scheduler);
+    }
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include "BenchUtil.h"
+#include "BufferDiff.h"
+#include "TileHash.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Weighs the cost of finding the damage of a repainted frame against
+ * the upload it saves, for the three HOMESCREEN_LEGACY_DAMAGE modes at
+ * 1080p and 4K. The upload is modelled as a row by row copy of every
+ * damaged rect into a texture sized buffer, which is what a compositor
+ * does with damaged shm buffers.
+ */
+
+#define RUNS 15
+
+enum mode {
+    MODE_TILES,
+    MODE_DIFF,
+    MODE_FULL
+};
+
+static const char *mode_names[] = { "tiles", "diff", "full" };
+
+struct change {
+    const char *name;
+    /* the repainted area, in fractions of the frame */
+    float x, y, width, height;
+};
+
+static const change changes[] = {
+    { "none", 0, 0, 0, 0 },
+    { "clock", 0.85f, 0.02f, 0.1f, 0.04f },
+    { "panel", 0, 0, 1, 0.1f },
+    { "everything", 0, 0, 1, 1 },
+};
+
+static void upload(uint32_t *texture, const uint32_t *pixels, int32_t stride, const std::vector<rect> &damage)
+{
+    for (auto &r : damage) {
+        for (int32_t y = r.y; y < r.y + r.height; y++)
+            memcpy(texture + (size_t) y * stride + r.x, pixels + (size_t) y * stride + r.x,
+                   r.width * sizeof(uint32_t));
+    }
+}
+
+static void run(int32_t width, int32_t height)
+{
+    std::vector<uint32_t> previous((size_t) width * height);
+    std::vector<uint32_t> texture((size_t) width * height);
+    fill_pixels(previous, 1);
+
+    for (auto &c : changes) {
+        std::vector<uint32_t> current = previous;
+        rect area = make_rect((int32_t) (c.x * width), (int32_t) (c.y * height),
+                              (int32_t) (c.width * width), (int32_t) (c.height * height));
+        for (int32_t y = area.y; y < area.y + area.height; y++) {
+            for (int32_t x = area.x; x < area.x + area.width; x++)
+                current[(size_t) y * width + x] ^= 0x00ffffff;
+        }
+
+        FrameTileHashes primed;
+        primed.reset(width, height);
+        std::vector<rect> damage;
+        primed.compare(previous.data(), width, damage);
+
+        for (int m = MODE_TILES; m <= MODE_FULL; m++) {
+            std::vector<rect> damage;
+            damage.reserve(1024);
+            auto find = [&]() {
+                damage.clear();
+                bool changed = true;
+                if (m == MODE_TILES) {
+                    /* the copy of the hashes is a few KB even at 4K */
+                    FrameTileHashes hashes = primed;
+                    changed = hashes.compare(current.data(), width, damage);
+                } else if (m == MODE_DIFF) {
+                    changed = diff_buffers(current.data(), previous.data(), width, width, height, damage);
+                } else {
+                    damage.push_back(make_rect(0, 0, width, height));
+                }
+                return changed;
+            };
+
+            double find_ms = median_ms(RUNS, [&]() { find(); });
+            find();
+            double upload_ms = median_ms(RUNS, [&]() { upload(texture.data(), current.data(), width, damage); });
+            uint64_t pixels = 0;
+            for (auto &r : damage)
+                pixels += (uint64_t) r.width * r.height;
+
+            printf("%4dx%-4d %-10s %-5s %9.3f %10llu %9.3f %9.3f\n", width, height, c.name, mode_names[m],
+                   find_ms, (unsigned long long) (pixels * 4 / 1024), upload_ms, find_ms + upload_ms);
+        }
+    }
+}
+
+int main()
+{
+    printf("%-9s %-10s %-5s %9s %10s %9s %9s\n", "size", "change", "mode", "find ms", "upload KB",
+           "upload ms", "total ms");
+    run(1920, 1080);
+    run(3840, 2160);
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "BenchUtil.h"
+#include "PixelKernels.h"
+#include "TaskScheduler.h"
+#include "TileHash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * Times TaskScheduler::parallel_for with 1 to N workers on homescreen
+ * workloads: a dithered gradient background at 1080p, a 1080p panel
+ * converted to RGB565 and the tile hashes of a 4K frame. N is the first
+ * argument, by default the number of online CPUs.
+ */
+
+#define RUNS 15
+#define ROW_GRAIN 16
+
+static const uint8_t dither[8] = { 0, 32, 8, 40, 2, 34, 10, 42 };
+
+struct workload {
+    const char *name;
+    std::function<void(TaskScheduler &)> run;
+};
+
+int main(int argc, char **argv)
+{
+    int max_workers = argc > 1 ? atoi(argv[1]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_workers < 1)
+        max_workers = 1;
+
+    const int32_t width = 1920, height = 1080;
+    const int32_t width_4k = 3840, height_4k = 2160;
+    std::vector<uint32_t> frame((size_t) width * height);
+    std::vector<uint16_t> frame_565((size_t) width * height);
+    std::vector<uint32_t> frame_4k((size_t) width_4k * height_4k);
+    std::vector<uint32_t> hashes((size_t) (width_4k / HASH_TILE_SIZE) * (height_4k / HASH_TILE_SIZE + 1));
+    fill_pixels(frame, 1);
+    fill_pixels(frame_4k, 2);
+
+    workload workloads[] = {
+        { "gradient 1080p", [&](TaskScheduler &scheduler) {
+            scheduler.parallel_for(0, height, ROW_GRAIN, [&](int32_t begin, int32_t end) {
+                std::vector<uint16_t> t(width);
+                for (int32_t y = begin; y < end; y++) {
+                    for (int32_t x = 0; x < width; x++)
+                        t[x] = (uint16_t) ((int64_t) (x + y) * 65535 / (width + height - 2));
+                    gradient_span(frame.data() + (size_t) y * width, t.data(), width,
+                                  0xff1c2430, 0xff05070a, dither);
+                }
+            });
+        } },
+        { "rgb565 1080p", [&](TaskScheduler &scheduler) {
+            scheduler.parallel_for(0, height, ROW_GRAIN, [&](int32_t begin, int32_t end) {
+                convert_rgb565(frame_565.data(), width, frame.data(), width,
+                               make_rect(0, begin, width, end - begin));
+            });
+        } },
+        { "tile hash 4K", [&](TaskScheduler &scheduler) {
+            int32_t columns = width_4k / HASH_TILE_SIZE;
+            int32_t rows = (height_4k + HASH_TILE_SIZE - 1) / HASH_TILE_SIZE;
+            scheduler.parallel_for(0, rows, 1, [&](int32_t begin, int32_t end) {
+                for (int32_t row = begin; row < end; row++) {
+                    for (int32_t column = 0; column < columns; column++) {
+                        rect tile = rect_intersect(make_rect(column * HASH_TILE_SIZE, row * HASH_TILE_SIZE,
+                                                             HASH_TILE_SIZE, HASH_TILE_SIZE),
+                                                   make_rect(0, 0, width_4k, height_4k));
+                        hashes[(size_t) row * columns + column] = hash_tile(frame_4k.data(), width_4k, tile);
+                    }
+                }
+            });
+        } },
+    };
+
+    printf("%-16s %8s %10s %8s\n", "workload", "workers", "median ms", "speedup");
+    for (auto &w : workloads) {
+        double single = 0;
+        for (int workers = 1; workers <= max_workers; workers++) {
+            task_scheduler_config config;
+            config.worker_count = workers;
+            TaskScheduler scheduler(config);
+            double ms = median_ms(RUNS, [&]() { w.run(scheduler); });
+            if (workers == 1)
+                single = ms;
+            printf("%-16s %8d %10.3f %7.2fx\n", w.name, workers, ms, single / ms);
+        }
+    }
+    return 0;
+}
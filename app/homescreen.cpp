@@ -30,12 +30,25 @@ handle_signal(int signum)
 	running = false;
 }
 
+static void
+handle_theme_signal(int signum)
+{
+	ExampleScene::request_theme_switch();
+}
+
 static void set_up_interrupt_handler() {
 	struct sigaction sigint;
 	sigint.sa_handler = handle_signal;
 	sigemptyset(&sigint.sa_mask);
 	sigint.sa_flags = SA_RESETHAND | SA_SIGINFO;
 	sigaction(SIGINT, &sigint, NULL);
+
+	/* SIGUSR1 flips between the day and night theme */
+	struct sigaction sigusr1;
+	sigusr1.sa_handler = handle_theme_signal;
+	sigemptyset(&sigusr1.sa_mask);
+	sigusr1.sa_flags = 0;
+	sigaction(SIGUSR1, &sigusr1, NULL);
 }
 
 /* entry function */